@@ -0,0 +1,84 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "AllocationCounter.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+
+namespace {
+std::atomic<std::size_t> allocation_count{0};
+}
+
+#if defined(__GLIBC__)
+
+// interpose the allocator of the executable, glibc exports the real implementations with a __libc_ prefix
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *pointer, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+void __libc_free(void *pointer);
+
+void *malloc(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pointer, size);
+}
+
+int posix_memalign(void **pointer, std::size_t alignment, std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    *pointer = __libc_memalign(alignment, size);
+    return *pointer ? 0 : ENOMEM;
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void *memalign(std::size_t alignment, std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void free(void *pointer) {
+    __libc_free(pointer);
+}
+}
+
+namespace traact::component::aruco::benchmark {
+
+std::size_t allocationCount() {
+    return allocation_count.load(std::memory_order_relaxed);
+}
+
+bool allocationCountAvailable() {
+    return true;
+}
+
+}
+
+#else
+
+namespace traact::component::aruco::benchmark {
+
+std::size_t allocationCount() {
+    return 0;
+}
+
+bool allocationCountAvailable() {
+    return false;
+}
+
+}
+
+#endif
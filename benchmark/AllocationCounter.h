@@ -0,0 +1,21 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_BENCHMARK_ALLOCATIONCOUNTER_H
+#define TRAACTMULTI_BENCHMARK_ALLOCATIONCOUNTER_H
+
+#include <cstddef>
+
+namespace traact::component::aruco::benchmark {
+
+/**
+ * Number of heap allocations of all threads since program start.
+ * Counts malloc and friends, so allocations of OpenCV (cv::fastMalloc) are included, not only operator new.
+ * Only available with glibc, returns 0 otherwise.
+ */
+std::size_t allocationCount();
+
+bool allocationCountAvailable();
+
+}
+
+#endif //TRAACTMULTI_BENCHMARK_ALLOCATIONCOUNTER_H
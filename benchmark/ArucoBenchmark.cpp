@@ -0,0 +1,767 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "SyntheticScene.h"
+#include "AllocationCounter.h"
+#include "ArucoModule.h"
+#include "DictionaryIndex.h"
+#include "FractalTracking.h"
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <thread>
+
+using namespace traact::component::aruco;
+using namespace traact::component::aruco::benchmark;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+struct LatencySummary {
+    double mean{0};
+    double p50{0};
+    double p90{0};
+    double p99{0};
+    double max{0};
+};
+
+LatencySummary summarize(std::vector<double> samples) {
+    LatencySummary summary;
+    if (samples.empty()) {
+        return summary;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        auto index = static_cast<std::size_t>(p * (samples.size() - 1) + 0.5);
+        return samples[std::min(index, samples.size() - 1)];
+    };
+    summary.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    summary.p50 = percentile(0.5);
+    summary.p90 = percentile(0.9);
+    summary.p99 = percentile(0.99);
+    summary.max = samples.back();
+    return summary;
+}
+
+struct ScenarioResult {
+    std::string name;
+    std::vector<std::pair<std::string, std::vector<double>>> stages;
+    /**
+     * allocations per frame of each stage, empty if not measured for the stage
+     */
+    std::vector<std::vector<std::size_t>> stage_allocations;
+    std::vector<std::size_t> allocations;
+    std::size_t expected_markers{0};
+    std::size_t found_markers{0};
+    double translation_error_sum{0};
+    double reprojection_error_sum{0};
+    std::size_t reprojection_error_count{0};
+};
+
+void printHeader() {
+    std::printf("%-40s %-8s %9s %8s %8s %8s %8s %8s %10s %7s %9s %9s\n",
+                "scenario", "stage", "fps", "mean_ms", "p50_ms", "p90_ms", "p99_ms", "max_ms",
+                "allocs/fr", "recall", "t_err_mm", "reproj_px");
+}
+
+double meanAllocations(const std::vector<std::size_t> &allocations) {
+    return allocations.empty() ? 0.0 :
+           static_cast<double>(std::accumulate(allocations.begin(), allocations.end(), std::size_t{0}))
+               / allocations.size();
+}
+
+void printAllocations(const std::vector<std::size_t> &allocations) {
+    if (allocationCountAvailable()) {
+        std::printf(" %10.1f", meanAllocations(allocations));
+    } else {
+        std::printf(" %10s", "n/a");
+    }
+}
+
+void printResult(const ScenarioResult &result) {
+    auto recall = result.expected_markers == 0 ? 0.0 :
+                  static_cast<double>(result.found_markers) / result.expected_markers;
+    auto translation_error = result.found_markers == 0 ? 0.0 :
+                             1000.0 * result.translation_error_sum / result.found_markers;
+    auto reprojection_error = result.reprojection_error_count == 0 ? 0.0 :
+                              result.reprojection_error_sum / result.reprojection_error_count;
+
+    for (std::size_t stage_index = 0; stage_index < result.stages.size(); ++stage_index) {
+        const auto &[stage_name, samples] = result.stages[stage_index];
+        auto summary = summarize(samples);
+        auto is_total = stage_name == "total";
+        std::printf("%-40s %-8s %9.1f %8.3f %8.3f %8.3f %8.3f %8.3f",
+                    result.name.c_str(), stage_name.c_str(),
+                    summary.mean > 0 ? 1000.0 / summary.mean : 0.0,
+                    summary.mean, summary.p50, summary.p90, summary.p99, summary.max);
+        if (is_total) {
+            printAllocations(result.allocations);
+            std::printf(" %7.3f %9.3f %9.3f", recall, translation_error, reprojection_error);
+        } else if (stage_index < result.stage_allocations.size() && !result.stage_allocations[stage_index].empty()) {
+            printAllocations(result.stage_allocations[stage_index]);
+        }
+        std::printf("\n");
+    }
+    std::fflush(stdout);
+}
+
+/**
+ * Replays the detections of the OpenCV backend on the scene frames in a loop.
+ * The detect stage then only measures the glue of ArucoModule and SquareMarkerDetector around the detector.
+ */
+class RecordedDetectorBackend : public DetectorBackend {
+ public:
+    RecordedDetectorBackend(const SyntheticScene &scene, const cv::aruco::Dictionary &dictionary) {
+        OpenCVDetectorBackend detector(dictionary, cv::aruco::DetectorParameters());
+        detections_.resize(scene.frames.size());
+        for (std::size_t i = 0; i < scene.frames.size(); ++i) {
+            detector.detect(scene.frames[i].image, detections_[i].first, detections_[i].second, nullptr);
+        }
+    }
+
+    bool setDictionary(const cv::aruco::Dictionary &dictionary) override {
+        return true;
+    }
+    void setParameters(const cv::aruco::DetectorParameters &parameters) override {}
+
+    void detect(const cv::Mat &image, MarkerCorners &markers, MarkerIds &marker_ids, MarkerCorners *rejected) override {
+        const auto &[recorded_markers, recorded_ids] = detections_[next_frame_];
+        next_frame_ = (next_frame_ + 1) % detections_.size();
+        markers.resize(recorded_markers.size());
+        for (std::size_t i = 0; i < recorded_markers.size(); ++i) {
+            markers[i].assign(recorded_markers[i].begin(), recorded_markers[i].end());
+        }
+        marker_ids.assign(recorded_ids.begin(), recorded_ids.end());
+        if (rejected) {
+            rejected->clear();
+        }
+    }
+
+    bool supportsRejected() const override {
+        return false;
+    }
+
+ private:
+    std::vector<std::pair<MarkerCorners, MarkerIds>> detections_;
+    std::size_t next_frame_{0};
+};
+
+/**
+ * DetectMarkers, EstimatePoses, with a motion filter FilterPoses, and SendFrame of ArucoModule, every rendered
+ * marker has a subscribed output. Without temporal refine every marker is solved from scratch with IPPE_SQUARE.
+ *
+ * There is no dataflow to provide output buffers, the outputs request them from a stub that returns no buffer. So
+ * the send stage covers requesting, dispatching and committing the outputs but not filling them. The allocations
+ * of the stub for the future of each buffer belong to traact and are not counted in the send stage.
+ */
+ScenarioResult measureMarkerScene(const std::string &name,
+                                  const SceneConfig &config,
+                                  const SyntheticScene &scene,
+                                  bool temporal_refine,
+                                  SquareMarkerDetector &detector,
+                                  int frames,
+                                  int warmup,
+                                  const MotionFilterConfig &motion_filter = MotionFilterConfig()) {
+    ArucoModule module;
+    module.SetTemporalRefine(temporal_refine);
+    module.SetMotionFilter(motion_filter);
+    module.SetDictionary(cv::aruco::getPredefinedDictionary(config.dictionary));
+    std::size_t request_allocations{0};
+    auto request_buffer = [&request_allocations](traact::Timestamp) {
+        auto allocations_before = allocationCount();
+        std::promise<traact::buffer::SourceComponentBuffer *> buffer;
+        auto buffer_future = buffer.get_future();
+        buffer.set_value(nullptr);
+        request_allocations += allocationCount() - allocations_before;
+        return buffer_future;
+    };
+
+    std::vector<std::unique_ptr<ArucoOutputComponent>> outputs;
+    // output slots are added in ground truth order
+    for (const auto &ground_truth : scene.frames.front().ground_truth) {
+        outputs.emplace_back(std::make_unique<ArucoOutputComponent>(
+            "benchmark_output_" + std::to_string(ground_truth.marker_id)));
+        outputs.back()->setRequestCallback(request_buffer);
+        module.AddOutput(ground_truth.marker_id, outputs.back().get());
+    }
+    ArucoListOutputComponent list_output("benchmark_list_output");
+    list_output.setRequestCallback(request_buffer);
+    module.AddListOutput(&list_output);
+    // renders every frame
+    ArucoDebugOutputComponent debug_output("benchmark_debug_output");
+    debug_output.setRequestCallback(request_buffer);
+    module.SetDebugOutput(&debug_output);
+    // the stub buffers are committed as missing, which is logged for every output
+    auto log_level = spdlog::get_level();
+    spdlog::set_level(spdlog::level::off);
+
+    MarkerFrame frame;
+    frame.marker_index_by_id.assign(cv::aruco::getPredefinedDictionary(config.dictionary).bytesList.rows, -1);
+
+    ScenarioResult result;
+    result.name = name;
+    auto with_filter = motion_filter.model != MotionModel::NONE;
+    result.stages = {{"detect", {}}, {"pose", {}}};
+    if (with_filter) {
+        result.stages.push_back({"filter", {}});
+    }
+    result.stages.push_back({"send", {}});
+    result.stage_allocations.resize(result.stages.size());
+    result.stages.push_back({"total", {}});
+
+    for (int i = 0; i < warmup + frames; ++i) {
+        const auto &scene_frame = scene.frames[i % scene.frames.size()];
+        // 30Hz time points for the motion filter
+        traact::Timestamp ts(std::chrono::duration_cast<traact::Timestamp::duration>(std::chrono::microseconds(33333) * i));
+
+        auto allocations_before = allocationCount();
+        auto start = Clock::now();
+        module.DetectMarkers(scene_frame.image, detector, frame);
+        auto detected = Clock::now();
+        auto allocations_detected = allocationCount();
+        module.EstimatePoses(scene_frame.image, scene.calibration, config.marker_size, frame);
+        auto estimated = Clock::now();
+        auto allocations_estimated = allocationCount();
+        if (with_filter) {
+            module.FilterPoses(ts, frame);
+        }
+        auto filtered = Clock::now();
+        auto allocations_filtered = allocationCount();
+        request_allocations = 0;
+        module.SendFrame(ts, scene_frame.image, frame);
+        auto end = Clock::now();
+        auto allocations_end = allocationCount() - request_allocations;
+
+        if (i < warmup) {
+            continue;
+        }
+        result.stages[0].second.push_back(elapsedMs(start, detected));
+        result.stages[1].second.push_back(elapsedMs(detected, estimated));
+        result.stage_allocations[0].push_back(allocations_detected - allocations_before);
+        result.stage_allocations[1].push_back(allocations_estimated - allocations_detected);
+        if (with_filter) {
+            result.stages[2].second.push_back(elapsedMs(estimated, filtered));
+            result.stage_allocations[2].push_back(allocations_filtered - allocations_estimated);
+        }
+        auto send_stage = result.stage_allocations.size() - 1;
+        result.stages[send_stage].second.push_back(elapsedMs(filtered, end));
+        result.stage_allocations[send_stage].push_back(allocations_end - allocations_filtered);
+        result.stages.back().second.push_back(elapsedMs(start, end));
+        result.allocations.push_back(allocations_end - allocations_before);
+        for (auto reprojection_error : frame.reprojection_errors) {
+            result.reprojection_error_sum += reprojection_error;
+            ++result.reprojection_error_count;
+        }
+
+        for (std::size_t output_index = 0; output_index < scene_frame.ground_truth.size(); ++output_index) {
+            ++result.expected_markers;
+            auto marker_index = frame.marker_index_by_output[output_index];
+            if (marker_index < 0) {
+                continue;
+            }
+            ++result.found_markers;
+            result.translation_error_sum +=
+                cv::norm(frame.t_vecs[marker_index] - scene_frame.ground_truth[output_index].t_vec);
+        }
+    }
+    spdlog::set_level(log_level);
+
+    return result;
+}
+
+ScenarioResult runMarkerScenario(const std::string &name,
+                                 const SceneConfig &config,
+                                 bool temporal_refine,
+                                 DecodeMode decode_mode,
+                                 DetectorBackendType backend_type,
+                                 int frames,
+                                 int warmup) {
+    auto scene = renderMarkerScene(config);
+    SquareMarkerDetector detector(cv::aruco::getPredefinedDictionary(config.dictionary),
+                                  cv::aruco::DetectorParameters(),
+                                  backend_type);
+    detector.setDecodeMode(decode_mode);
+    return measureMarkerScene(name, config, scene, temporal_refine, detector, frames, warmup);
+}
+
+/**
+ * Decode the candidates of cv::aruco::ArucoDetector with a DictionaryIndex. Markers found by OpenCV have to be
+ * identified with the same id and corner order, rejected candidates have to be rejected.
+ *
+ * @return number of candidates decoded differently
+ */
+std::size_t checkLookupDecoding(const std::string &name, const SceneConfig &config) {
+    auto scene = renderMarkerScene(config);
+    auto dictionary = cv::aruco::getPredefinedDictionary(config.dictionary);
+    cv::aruco::DetectorParameters parameters;
+    cv::aruco::ArucoDetector detector(dictionary, parameters);
+    DictionaryIndex index;
+    if (!index.build(dictionary, parameters.errorCorrectionRate)) {
+        std::fprintf(stderr, "%s: dictionary can not be indexed\n", name.c_str());
+        return 1;
+    }
+
+    std::vector<std::vector<cv::Point2f>> markers;
+    std::vector<int> marker_ids;
+    std::vector<std::vector<cv::Point2f>> rejected;
+    std::vector<cv::Point2f> corners;
+    std::size_t candidates{0};
+    std::size_t mismatches{0};
+    for (const auto &scene_frame : scene.frames) {
+        detector.detectMarkers(scene_frame.image, markers, marker_ids, rejected);
+        for (std::size_t i = 0; i < markers.size(); ++i) {
+            corners = markers[i];
+            int marker_id{-1};
+            if (!index.identify(scene_frame.image, corners, marker_id, parameters) || marker_id != marker_ids[i]
+                || corners != markers[i]) {
+                ++mismatches;
+            }
+        }
+        for (const auto &candidate : rejected) {
+            corners = candidate;
+            int marker_id{-1};
+            if (index.identify(scene_frame.image, corners, marker_id, parameters)) {
+                ++mismatches;
+            }
+        }
+        candidates += markers.size() + rejected.size();
+    }
+    std::printf("%-40s %zu candidates, %zu decoded differently\n", name.c_str(), candidates, mismatches);
+    std::fflush(stdout);
+    return mismatches;
+}
+
+/**
+ * runMarkerScenario with the full frame search split into tiles, 0 searches the whole frame.
+ * Markers are limited to a side of 0.15 of the image width, with a max_marker_perimeter_rate of 0.6 the overlap of
+ * the tiles covers them. 0 keeps the default parameters, as a graph that only sets tile_size.
+ *
+ * @param tile_count tiles of the last frame
+ */
+ScenarioResult runTiledScenario(const std::string &name,
+                                const SceneConfig &config,
+                                int tile_size,
+                                double max_marker_perimeter_rate,
+                                int frames,
+                                int warmup,
+                                std::size_t &tile_count) {
+    auto scene = renderMarkerScene(config);
+    cv::aruco::DetectorParameters parameters;
+    if (max_marker_perimeter_rate > 0) {
+        parameters.maxMarkerPerimeterRate = max_marker_perimeter_rate;
+    }
+    SquareMarkerDetector detector(cv::aruco::getPredefinedDictionary(config.dictionary),
+                                  parameters,
+                                  DetectorBackendType::OPENCV);
+    detector.setDecodeMode(DecodeMode::AUTO);
+    detector.setTiling(tile_size, 0);
+    auto result = measureMarkerScene(name, config, scene, true, detector, frames, warmup);
+    tile_count = detector.tileCount();
+    return result;
+}
+
+/**
+ * A tile size smaller than the image has to split the search with any detector parameters
+ */
+bool checkTiling(const ScenarioResult &result, std::size_t tile_count) {
+    if (tile_count == 0) {
+        std::fprintf(stderr, "%s: the whole frame was searched instead of tiles\n", result.name.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * runMarkerScenario with recorded detections and a constant acceleration motion filter, see checkSteadyState
+ */
+ScenarioResult runSteadyStateScenario(const std::string &name, const SceneConfig &config, int frames, int warmup) {
+    auto scene = renderMarkerScene(config);
+    auto dictionary = cv::aruco::getPredefinedDictionary(config.dictionary);
+    SquareMarkerDetector detector(dictionary,
+                                  cv::aruco::DetectorParameters(),
+                                  std::make_unique<RecordedDetectorBackend>(scene, dictionary));
+    MotionFilterConfig motion_filter;
+    motion_filter.model = MotionModel::CONSTANT_ACCELERATION;
+    motion_filter.prediction_horizon = 0.03;
+    motion_filter.max_dropout = 0.1;
+    return measureMarkerScene(name, config, scene, true, detector, frames, warmup, motion_filter);
+}
+
+/**
+ * After the warmup the detect, filter and send stages must not allocate. Detection uses recorded detections, so the
+ * detect stage covers the bookkeeping of SquareMarkerDetector and ArucoModule, not the OpenCV candidate search. The
+ * pose stage allocates inside cv::solvePnP and cv::solvePnPRefineLM, which this component can not avoid, so it has
+ * to allocate the same in every frame: a growing count would be a buffer of the module. The frames of a scene
+ * repeat with the same marker count.
+ */
+bool checkSteadyState(const ScenarioResult &result) {
+    if (!allocationCountAvailable()) {
+        std::fprintf(stderr, "%s: allocation counting not available, steady state not checked\n",
+                     result.name.c_str());
+        return true;
+    }
+    bool passed = true;
+    for (std::size_t stage_index = 0; stage_index < result.stage_allocations.size(); ++stage_index) {
+        const auto &stage_name = result.stages[stage_index].first;
+        const auto &allocations = result.stage_allocations[stage_index];
+        if (allocations.empty()) {
+            continue;
+        }
+        auto [min_allocations, max_allocations] = std::minmax_element(allocations.begin(), allocations.end());
+        auto must_be_zero = stage_name != "pose";
+        if (must_be_zero ? *max_allocations > 0 : *max_allocations != *min_allocations) {
+            std::fprintf(stderr, "%s: %s stage allocates %zu to %zu times per frame in the steady state\n",
+                         result.name.c_str(), stage_name.c_str(), *min_allocations, *max_allocations);
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+/**
+ * Per frame work of ArucoFractalTracker::processTimePoint, with or without region tracking
+ */
+ScenarioResult runFractalScenario(const std::string &name,
+                                  const SceneConfig &config,
+                                  ::aruco::FractalMarkerSet::CONF_TYPES marker_config,
+                                  bool tracking,
+                                  int frames,
+                                  int warmup) {
+    auto scene = renderFractalScene(config, marker_config);
+
+    FractalTracking fractal_tracking;
+    fractal_tracking.setConfiguration(marker_config, config.marker_size);
+    fractal_tracking.setTracking(tracking, 30, 0.5);
+    ArucoStatistics warmup_statistics;
+    ArucoStatistics statistics;
+    FractalResult fractal_result;
+
+    ScenarioResult result;
+    result.name = name;
+    result.stages = {{"detect", {}}, {"pose", {}}, {"total", {}}};
+
+    for (int i = 0; i < warmup + frames; ++i) {
+        const auto &scene_frame = scene.frames[i % scene.frames.size()];
+        auto &frame_statistics = i < warmup ? warmup_statistics : statistics;
+
+        auto allocations_before = allocationCount();
+        auto start = Clock::now();
+        traact::Timestamp ts(std::chrono::duration_cast<traact::Timestamp::duration>(std::chrono::microseconds(33333) * i));
+        fractal_tracking.process(ts, scene_frame.image, scene.calibration, frame_statistics, fractal_result);
+        auto end = Clock::now();
+        auto allocations = allocationCount() - allocations_before;
+
+        if (i < warmup) {
+            continue;
+        }
+        result.stages[2].second.push_back(elapsedMs(start, end));
+        result.allocations.push_back(allocations);
+
+        ++result.expected_markers;
+        if (fractal_result.found) {
+            ++result.found_markers;
+            result.translation_error_sum += cv::norm(fractal_result.t_vec - scene_frame.ground_truth.front().t_vec);
+        }
+    }
+
+    // detection and pose are timed inside FractalTracking, keyframes and region frames mixed
+    auto detection = statistics.summarize(ArucoStage::DETECTION);
+    auto pose = statistics.summarize(ArucoStage::POSE_ESTIMATION);
+    result.stages[0].second.assign(1, detection.mean_ms);
+    result.stages[1].second.assign(1, pose.mean_ms);
+    result.reprojection_error_sum = statistics.meanReprojectionError();
+    result.reprojection_error_count = 1;
+    return result;
+}
+
+/**
+ * Frames submitted at a fixed input rate to a DetectionPipeline, detection on the workers and pose estimation
+ * on the emitter as in ArucoModule::StartPipeline. Reports the latency from submission to emission.
+ */
+void runPipelineScenario(const std::string &name,
+                         const SceneConfig &config,
+                         int workers,
+                         double input_hz,
+                         int frames) {
+    auto scene = renderMarkerScene(config);
+
+    ArucoModule module;
+    std::vector<std::unique_ptr<ArucoOutputComponent>> outputs;
+    for (const auto &ground_truth : scene.frames.front().ground_truth) {
+        outputs.emplace_back(std::make_unique<ArucoOutputComponent>(
+            "benchmark_output_" + std::to_string(ground_truth.marker_id)));
+        module.AddOutput(ground_truth.marker_id, outputs.back().get());
+    }
+
+    std::vector<double> latencies;
+    std::size_t emitted{0};
+    std::size_t invalid{0};
+    std::int64_t previous_ts{-1};
+    bool in_order{true};
+    {
+        DetectionPipeline pipeline(
+            workers, 2 * workers, DropPolicy::DROP_OLDEST,
+            [&config]() {
+                return std::make_unique<SquareMarkerDetector>(cv::aruco::getPredefinedDictionary(config.dictionary),
+                                                              cv::aruco::DetectorParameters());
+            },
+            [&module](PipelineFrame &pipeline_frame, SquareMarkerDetector &detector) {
+                module.DetectMarkers(pipeline_frame.image, detector, pipeline_frame.frame);
+            },
+            [&](PipelineFrame &pipeline_frame) {
+                auto ts = pipeline_frame.ts.time_since_epoch().count();
+                in_order = in_order && ts > previous_ts;
+                previous_ts = ts;
+                ++emitted;
+                if (!pipeline_frame.valid) {
+                    ++invalid;
+                    return;
+                }
+                module.EstimatePoses(pipeline_frame.image, pipeline_frame.calibration, pipeline_frame.marker_size,
+                                     pipeline_frame.frame);
+                auto submitted = Clock::time_point(std::chrono::nanoseconds(ts));
+                latencies.push_back(elapsedMs(submitted, Clock::now()));
+            });
+
+        auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / input_hz));
+        auto next_submit = Clock::now();
+        for (int i = 0; i < frames; ++i) {
+            std::this_thread::sleep_until(next_submit);
+            next_submit += period;
+            auto pipeline_frame = std::make_unique<PipelineFrame>();
+            // the steady clock submission time is used as timestamp to measure the latency
+            pipeline_frame->ts = traact::Timestamp(std::chrono::duration_cast<traact::Timestamp::duration>(
+                Clock::now().time_since_epoch()));
+            pipeline_frame->valid = true;
+            pipeline_frame->image = scene.frames[i % scene.frames.size()].image;
+            pipeline_frame->calibration = scene.calibration;
+            pipeline_frame->marker_size = config.marker_size;
+            pipeline.submit(std::move(pipeline_frame));
+        }
+        pipeline.stop();
+    }
+
+    auto summary = summarize(latencies);
+    auto detected_hz = input_hz * static_cast<double>(emitted - invalid) / std::max<std::size_t>(1, emitted);
+    std::printf("%-40s %-8s %9.1f %8.3f %8.3f %8.3f %8.3f %8.3f   input %.0fHz workers %d dropped %zu/%zu %s\n",
+                name.c_str(), "latency", detected_hz,
+                summary.mean, summary.p50, summary.p90, summary.p99, summary.max,
+                input_hz, workers, invalid, emitted, in_order ? "in order" : "OUT OF ORDER");
+    std::fflush(stdout);
+}
+
+std::string scenarioName(const std::string &prefix, const SceneConfig &config, bool with_marker_count) {
+    auto name = prefix + "_" + std::to_string(config.width) + "x" + std::to_string(config.height);
+    if (with_marker_count) {
+        name += "_m" + std::to_string(config.marker_count);
+    }
+    if (config.blur_sigma > 0 || config.noise_sigma > 0) {
+        name += "_degraded";
+    }
+    return name;
+}
+
+}
+
+int main(int argc, char **argv) {
+    const std::string keys =
+        "{help h         |      | print this message }"
+        "{frames         | 200  | measured frames per scenario }"
+        "{warmup         | 20   | frames run before measuring }"
+        "{width          | 0    | only run a single scenario with this width }"
+        "{height         | 0    | height of the single scenario }"
+        "{markers        | 10   | marker count of the single scenario }"
+        "{blur           | 0.0  | gaussian blur sigma of the single scenario }"
+        "{noise          | 0.0  | gaussian noise sigma of the single scenario }"
+        "{fractal        | true | run the fractal marker scenarios }"
+        "{compare_pose   | true | also run the marker scenarios without temporal refine }"
+        "{decode         | true | check and compare OpenCV and lookup table decoding over dictionary sizes }"
+        "{backend        | true | compare the OpenCV and aruco library detector backends }"
+        "{pipeline       | 4    | workers of the pipelined scenario at 120Hz input, 0 skips it }"
+        "{steady_state   | true | check the allocations of a frame with recorded detections }"
+        "{tiles          | 1024 | tile size of the tiled detection scenarios, 0 skips them }";
+    cv::CommandLineParser parser(argc, argv, keys);
+    parser.about("Benchmark of the traact aruco components on synthetic marker scenes");
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+
+    auto frames = parser.get<int>("frames");
+    auto warmup = parser.get<int>("warmup");
+
+    std::vector<SceneConfig> marker_scenes;
+    if (parser.get<int>("width") > 0) {
+        SceneConfig config;
+        config.width = parser.get<int>("width");
+        config.height = parser.get<int>("height") > 0 ? parser.get<int>("height") : config.width * 9 / 16;
+        config.marker_count = parser.get<int>("markers");
+        config.blur_sigma = parser.get<double>("blur");
+        config.noise_sigma = parser.get<double>("noise");
+        marker_scenes.push_back(config);
+    } else {
+        for (auto [width, height] : {std::pair{1280, 720}, std::pair{1920, 1080}, std::pair{3840, 2160}}) {
+            for (auto marker_count : {1, 10, 40}) {
+                SceneConfig config;
+                config.width = width;
+                config.height = height;
+                config.marker_count = marker_count;
+                marker_scenes.push_back(config);
+            }
+        }
+        SceneConfig degraded;
+        degraded.blur_sigma = 1.0;
+        degraded.noise_sigma = 4.0;
+        marker_scenes.push_back(degraded);
+    }
+
+    printHeader();
+    for (const auto &config : marker_scenes) {
+        printResult(runMarkerScenario(scenarioName("marker", config, true), config, true, DecodeMode::AUTO,
+                                      DetectorBackendType::OPENCV, frames, warmup));
+        if (parser.get<bool>("compare_pose")) {
+            printResult(runMarkerScenario(scenarioName("marker", config, true) + "_cold", config, false,
+                                          DecodeMode::AUTO, DetectorBackendType::OPENCV, frames, warmup));
+        }
+    }
+
+    if (parser.get<bool>("decode")) {
+        // markers from the end of the dictionary, the worst case of the linear search
+        const std::pair<const char *, cv::aruco::PredefinedDictionaryType> dictionaries[] = {
+            {"4x4_50", cv::aruco::DICT_4X4_50},
+            {"4x4_250", cv::aruco::DICT_4X4_250},
+            {"4x4_1000", cv::aruco::DICT_4X4_1000},
+            {"6x6_1000", cv::aruco::DICT_6X6_1000},
+            {"apriltag_36h11", cv::aruco::DICT_APRILTAG_36h11},
+            {"mip_36h12", cv::aruco::DICT_ARUCO_MIP_36h12}};
+        for (const auto &[dictionary_name, dictionary] : dictionaries) {
+            SceneConfig config;
+            config.width = 1280;
+            config.height = 720;
+            config.marker_count = 20;
+            config.dictionary = dictionary;
+            config.first_marker_id = std::numeric_limits<int>::max();
+            auto name = std::string("decode_") + dictionary_name;
+            // the lookup has to accept exactly the candidates opencv accepts, degraded frames add bit errors
+            auto degraded = config;
+            degraded.blur_sigma = 1.0;
+            degraded.noise_sigma = 8.0;
+            if (checkLookupDecoding(name + "_check", config) + checkLookupDecoding(name + "_check_degraded", degraded)
+                > 0) {
+                std::fprintf(stderr, "%s: lookup decoding differs from OpenCV\n", name.c_str());
+                return 1;
+            }
+            printResult(runMarkerScenario(name + "_opencv", config, true, DecodeMode::OPENCV,
+                                          DetectorBackendType::OPENCV, frames, warmup));
+            printResult(runMarkerScenario(name + "_lookup", config, true, DecodeMode::LOOKUP,
+                                          DetectorBackendType::OPENCV, frames, warmup));
+        }
+    }
+
+    if (parser.get<bool>("backend")) {
+        // ARUCO_MIP_36h12 is decoded by both libraries with the same ids
+        std::vector<SceneConfig> backend_scenes;
+        for (auto [width, height] : {std::pair{1280, 720}, std::pair{1920, 1080}, std::pair{3840, 2160}}) {
+            SceneConfig config;
+            config.width = width;
+            config.height = height;
+            config.dictionary = cv::aruco::DICT_ARUCO_MIP_36h12;
+            backend_scenes.push_back(config);
+        }
+        SceneConfig degraded;
+        degraded.dictionary = cv::aruco::DICT_ARUCO_MIP_36h12;
+        degraded.blur_sigma = 1.0;
+        degraded.noise_sigma = 4.0;
+        backend_scenes.push_back(degraded);
+
+        const std::pair<const char *, DetectorBackendType> backends[] = {
+            {"_opencv", DetectorBackendType::OPENCV},
+            {"_aruco_fast", DetectorBackendType::ARUCO_FAST},
+            {"_aruco_video_fast", DetectorBackendType::ARUCO_VIDEO_FAST}};
+        for (const auto &config : backend_scenes) {
+            for (const auto &[suffix, backend_type] : backends) {
+                printResult(runMarkerScenario(scenarioName("backend", config, true) + suffix, config, true,
+                                              DecodeMode::OPENCV, backend_type, frames, warmup));
+            }
+        }
+    }
+
+    if (parser.get<bool>("fractal")) {
+        for (auto [width, height] : {std::pair{1920, 1080}, std::pair{3840, 2160}}) {
+            SceneConfig config;
+            config.width = width;
+            config.height = height;
+            config.marker_size = 0.1;
+            for (auto tracking : {false, true}) {
+                auto suffix = tracking ? "_roi" : "";
+                printResult(runFractalScenario(scenarioName("fractal_2l", config, false) + suffix, config,
+                                               ::aruco::FractalMarkerSet::CONF_TYPES::FRACTAL_2L_6, tracking,
+                                               frames, warmup));
+                printResult(runFractalScenario(scenarioName("fractal_4l", config, false) + suffix, config,
+                                               ::aruco::FractalMarkerSet::CONF_TYPES::FRACTAL_4L_6, tracking,
+                                               frames, warmup));
+            }
+        }
+    }
+
+    if (parser.get<int>("pipeline") > 0) {
+        SceneConfig config;
+        config.width = 3840;
+        config.height = 2160;
+        config.marker_count = 40;
+        printResult(runMarkerScenario(scenarioName("pipeline_single", config, true), config, true, DecodeMode::AUTO,
+                                      DetectorBackendType::OPENCV, frames, warmup));
+        runPipelineScenario(scenarioName("pipeline", config, true), config, parser.get<int>("pipeline"), 120.0,
+                            frames);
+    }
+
+    if (parser.get<int>("tiles") > 0) {
+        auto tile_size = parser.get<int>("tiles");
+        for (auto marker_count : {10, 40}) {
+            SceneConfig config;
+            config.width = 3840;
+            config.height = 2160;
+            config.marker_count = marker_count;
+            auto name = scenarioName("tiles", config, true);
+            std::size_t tile_count;
+            printResult(runTiledScenario(name + "_full", config, 0, 0.6, frames, warmup, tile_count));
+            auto result = runTiledScenario(name + "_" + std::to_string(tile_size), config, tile_size, 0.6, frames,
+                                           warmup, tile_count);
+            printResult(result);
+            if (!checkTiling(result, tile_count)) {
+                return 1;
+            }
+            // only tile_size set, the default maxMarkerPerimeterRate allows markers larger than a tile
+            result = runTiledScenario(name + "_" + std::to_string(tile_size) + "_defaults", config, tile_size, 0,
+                                      frames, warmup, tile_count);
+            printResult(result);
+            if (!checkTiling(result, tile_count)) {
+                return 1;
+            }
+        }
+    }
+
+    if (parser.get<bool>("steady_state")) {
+        SceneConfig config;
+        config.width = 1920;
+        config.height = 1080;
+        config.marker_count = 40;
+        auto result = runSteadyStateScenario(scenarioName("steady_state", config, true), config, frames, warmup);
+        printResult(result);
+        if (!checkSteadyState(result)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
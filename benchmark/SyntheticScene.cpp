@@ -0,0 +1,190 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "SyntheticScene.h"
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace traact::component::aruco::benchmark {
+
+namespace {
+
+cv::Matx33d toCameraMatrix(const vision::CameraCalibration &calibration) {
+    return cv::Matx33d(calibration.fx, calibration.skew, calibration.cx,
+                       0, calibration.fy, calibration.cy,
+                       0, 0, 1);
+}
+
+std::vector<cv::Point2f> projectSquare(const vision::CameraCalibration &calibration,
+                                       const cv::Vec3d &r_vec,
+                                       const cv::Vec3d &t_vec,
+                                       double half_size) {
+    // same corner order as the detected marker corners and estimatePoseSingleMarkers
+    std::vector<cv::Point3d> object_corners{
+        {-half_size, half_size, 0},
+        {half_size, half_size, 0},
+        {half_size, -half_size, 0},
+        {-half_size, -half_size, 0}
+    };
+    std::vector<cv::Point2f> image_corners;
+    cv::projectPoints(object_corners, r_vec, t_vec, toCameraMatrix(calibration), cv::noArray(), image_corners);
+    return image_corners;
+}
+
+void renderQuad(cv::Mat &image, const cv::Mat &texture, const std::vector<cv::Point2f> &image_corners) {
+    auto bounds = cv::boundingRect(image_corners) & cv::Rect(0, 0, image.cols, image.rows);
+    if (bounds.empty()) {
+        return;
+    }
+
+    auto side = static_cast<float>(texture.cols);
+    std::vector<cv::Point2f> texture_corners{
+        {-0.5f, -0.5f},
+        {side - 0.5f, -0.5f},
+        {side - 0.5f, side - 0.5f},
+        {-0.5f, side - 0.5f}
+    };
+    std::vector<cv::Point2f> local_corners;
+    for (const auto &corner : image_corners) {
+        local_corners.emplace_back(corner - cv::Point2f(bounds.tl()));
+    }
+    auto homography = cv::getPerspectiveTransform(texture_corners, local_corners);
+
+    cv::Mat warped;
+    cv::Mat mask;
+    cv::Mat texture_mask(texture.size(), CV_8UC1, cv::Scalar(255));
+    cv::warpPerspective(texture, warped, homography, bounds.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT, 0);
+    cv::warpPerspective(texture_mask, mask, homography, bounds.size(), cv::INTER_NEAREST, cv::BORDER_CONSTANT, 0);
+    warped.copyTo(image(bounds), mask);
+}
+
+void degrade(cv::Mat &image, const SceneConfig &config, std::uint64_t seed) {
+    if (config.blur_sigma > 0) {
+        cv::GaussianBlur(image, image, cv::Size(0, 0), config.blur_sigma);
+    }
+    if (config.noise_sigma > 0) {
+        cv::RNG rng(seed);
+        cv::Mat noise(image.size(), CV_16SC1);
+        rng.fill(noise, cv::RNG::NORMAL, 0, config.noise_sigma);
+        cv::Mat noisy;
+        image.convertTo(noisy, CV_16SC1);
+        noisy += noise;
+        noisy.convertTo(image, CV_8UC1);
+    }
+}
+
+cv::Mat addQuietZone(const cv::Mat &marker_image, int margin) {
+    cv::Mat texture;
+    cv::copyMakeBorder(marker_image, texture, margin, margin, margin, margin, cv::BORDER_CONSTANT, cv::Scalar(255));
+    return texture;
+}
+
+}
+
+vision::CameraCalibration createCalibration(int width, int height) {
+    vision::CameraCalibration calibration;
+    calibration.width = width;
+    calibration.height = height;
+    calibration.fx = 0.9 * width;
+    calibration.fy = 0.9 * width;
+    calibration.cx = width / 2.0;
+    calibration.cy = height / 2.0;
+    calibration.skew = 0;
+    calibration.radial_distortion = {0, 0, 0};
+    calibration.tangential_distortion = {0, 0};
+    return calibration;
+}
+
+SyntheticScene renderMarkerScene(const SceneConfig &config) {
+    SyntheticScene scene;
+    scene.calibration = createCalibration(config.width, config.height);
+    const auto &calibration = scene.calibration;
+
+    auto dictionary = cv::aruco::getPredefinedDictionary(config.dictionary);
+    auto marker_count = std::min(config.marker_count, dictionary.bytesList.rows);
+    auto first_marker_id = std::clamp(config.first_marker_id, 0, dictionary.bytesList.rows - marker_count);
+    auto grid_cols = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(marker_count))));
+    auto grid_rows = (marker_count + grid_cols - 1) / grid_cols;
+
+    // move the marker plane back until the grid fits into 80% of the view
+    auto spacing = 2.0 * config.marker_size;
+    auto distance = std::max({config.distance,
+                              grid_cols * spacing * calibration.fx / (0.8 * config.width),
+                              grid_rows * spacing * calibration.fy / (0.8 * config.height)});
+
+    auto cell_pixels = 8;
+    auto marker_pixels = (dictionary.markerSize + 2) * cell_pixels;
+    auto quiet_zone_scale = static_cast<double>(marker_pixels + 2 * cell_pixels) / marker_pixels;
+
+    cv::RNG rng(config.seed);
+    std::vector<cv::Mat> textures;
+    std::vector<MarkerGroundTruth> base_poses;
+    for (int i = 0; i < marker_count; ++i) {
+        cv::Mat marker_image;
+        cv::aruco::generateImageMarker(dictionary, first_marker_id + i, marker_pixels, marker_image, 1);
+        textures.emplace_back(addQuietZone(marker_image, cell_pixels));
+
+        auto col = i % grid_cols;
+        auto row = i / grid_cols;
+        cv::Vec3d t_vec((col - (grid_cols - 1) / 2.0) * spacing, (row - (grid_rows - 1) / 2.0) * spacing, distance);
+        cv::Vec3d r_vec(CV_PI + rng.uniform(-0.35, 0.35), rng.uniform(-0.35, 0.35), rng.uniform(-0.5, 0.5));
+        base_poses.push_back(MarkerGroundTruth{first_marker_id + i, r_vec, t_vec});
+    }
+
+    // about one pixel of motion per frame
+    auto step = distance / calibration.fx;
+    for (int frame_index = 0; frame_index < std::max(1, config.sequence_length); ++frame_index) {
+        SceneFrame frame;
+        frame.image = cv::Mat(config.height, config.width, CV_8UC1, cv::Scalar(128));
+        for (int i = 0; i < marker_count; ++i) {
+            auto pose = base_poses[i];
+            pose.t_vec[0] += frame_index * step;
+            pose.t_vec[1] += 0.5 * frame_index * step;
+            auto corners = projectSquare(calibration, pose.r_vec, pose.t_vec, config.marker_size / 2 * quiet_zone_scale);
+            renderQuad(frame.image, textures[i], corners);
+            frame.ground_truth.push_back(pose);
+        }
+        degrade(frame.image, config, config.seed + frame_index);
+        scene.frames.emplace_back(std::move(frame));
+    }
+
+    return scene;
+}
+
+SyntheticScene renderFractalScene(const SceneConfig &config, ::aruco::FractalMarkerSet::CONF_TYPES marker_config) {
+    SyntheticScene scene;
+    scene.calibration = createCalibration(config.width, config.height);
+    const auto &calibration = scene.calibration;
+
+    auto marker_set = ::aruco::FractalMarkerSet::loadPredefined(marker_config);
+    auto marker_pixels = 1024;
+    cv::Mat marker_image = marker_set.getFractalMarkerImage(marker_pixels, false);
+    if (marker_image.channels() != 1) {
+        cv::cvtColor(marker_image, marker_image, cv::COLOR_BGR2GRAY);
+    }
+    auto margin = marker_pixels / 8;
+    auto texture = addQuietZone(marker_image, margin);
+    auto quiet_zone_scale = static_cast<double>(texture.cols) / marker_image.cols;
+
+    // marker covers about 40% of the image height
+    auto distance = std::max(config.distance, config.marker_size * calibration.fy / (0.4 * config.height));
+
+    cv::RNG rng(config.seed);
+    cv::Vec3d r_vec(CV_PI + rng.uniform(-0.35, 0.35), rng.uniform(-0.35, 0.35), rng.uniform(-0.5, 0.5));
+    auto step = distance / calibration.fx;
+    for (int frame_index = 0; frame_index < std::max(1, config.sequence_length); ++frame_index) {
+        SceneFrame frame;
+        frame.image = cv::Mat(config.height, config.width, CV_8UC1, cv::Scalar(128));
+        cv::Vec3d t_vec(frame_index * step, 0.5 * frame_index * step, distance);
+        auto corners = projectSquare(calibration, r_vec, t_vec, config.marker_size / 2 * quiet_zone_scale);
+        renderQuad(frame.image, texture, corners);
+        frame.ground_truth.push_back(MarkerGroundTruth{0, r_vec, t_vec});
+        degrade(frame.image, config, config.seed + frame_index);
+        scene.frames.emplace_back(std::move(frame));
+    }
+
+    return scene;
+}
+
+}
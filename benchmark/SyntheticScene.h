@@ -0,0 +1,70 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_BENCHMARK_SYNTHETICSCENE_H
+#define TRAACTMULTI_BENCHMARK_SYNTHETICSCENE_H
+
+#include <traact/vision.h>
+#include <opencv2/aruco.hpp>
+#include <fractalmarkerset.h>
+#include <cstdint>
+#include <vector>
+
+namespace traact::component::aruco::benchmark {
+
+struct SceneConfig {
+    int width{1920};
+    int height{1080};
+    int marker_count{10};
+    /**
+     * marker side length in meter
+     */
+    double marker_size{0.08};
+    /**
+     * minimal distance of the marker plane to the camera in meter, increased if the markers do not fit the view
+     */
+    double distance{0.5};
+    double blur_sigma{0.0};
+    double noise_sigma{0.0};
+    cv::aruco::PredefinedDictionaryType dictionary{cv::aruco::DICT_4X4_50};
+    /**
+     * id of the first marker, clamped so all markers are part of the dictionary
+     */
+    int first_marker_id{0};
+    /**
+     * number of distinct frames, markers move by about one pixel per frame
+     */
+    int sequence_length{16};
+    std::uint64_t seed{42};
+};
+
+struct MarkerGroundTruth {
+    int marker_id;
+    cv::Vec3d r_vec;
+    cv::Vec3d t_vec;
+};
+
+struct SceneFrame {
+    cv::Mat image;
+    std::vector<MarkerGroundTruth> ground_truth;
+};
+
+struct SyntheticScene {
+    vision::CameraCalibration calibration;
+    std::vector<SceneFrame> frames;
+};
+
+vision::CameraCalibration createCalibration(int width, int height);
+
+/**
+ * Render single channel frames of a grid of square markers with known poses, deterministic for a given config
+ */
+SyntheticScene renderMarkerScene(const SceneConfig &config);
+
+/**
+ * Render single channel frames of one fractal marker with a known pose, marker_count is ignored
+ */
+SyntheticScene renderFractalScene(const SceneConfig &config, ::aruco::FractalMarkerSet::CONF_TYPES marker_config);
+
+}
+
+#endif //TRAACTMULTI_BENCHMARK_SYNTHETICSCENE_H
@@ -17,7 +17,7 @@ class TraactPackage(ConanFile):
     settings = "os", "compiler", "build_type", "arch"
     compiler = "cppstd"
 
-    exports_sources = "src/*", "CMakeLists.txt"
+    exports_sources = "src/*", "benchmark/*", "replay/*", "CMakeLists.txt"
 
     options = {
         "shared": [True, False],
@@ -0,0 +1,323 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "FrameSource.h"
+#include "PoseTrace.h"
+#include "ArucoModule.h"
+#include "FractalTracking.h"
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <string>
+
+using namespace traact::component::aruco;
+using namespace traact::component::aruco::replay;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// fractal marker sets have no id, their rows use this one
+constexpr std::int32_t kFractalMarkerId = -1;
+
+// in the order of cv::aruco::PredefinedDictionaryType
+const char *const kDictionaryNames[] = {
+    "DICT_4X4_50", "DICT_4X4_100", "DICT_4X4_250", "DICT_4X4_1000", "DICT_5X5_50", "DICT_5X5_100", "DICT_5X5_250",
+    "DICT_5X5_1000", "DICT_6X6_50", "DICT_6X6_100", "DICT_6X6_250", "DICT_6X6_1000", "DICT_7X7_50", "DICT_7X7_100",
+    "DICT_7X7_250", "DICT_7X7_1000", "DICT_ARUCO_ORIGINAL", "DICT_APRILTAG_16h5", "DICT_APRILTAG_25h9",
+    "DICT_APRILTAG_36h10", "DICT_APRILTAG_36h11", "DICT_ARUCO_MIP_36h12"};
+
+bool parseDictionary(const std::string &name, cv::aruco::PredefinedDictionaryType &dictionary) {
+    auto found = std::find(std::begin(kDictionaryNames), std::end(kDictionaryNames), name);
+    if (found == std::end(kDictionaryNames)) {
+        return false;
+    }
+    dictionary = static_cast<cv::aruco::PredefinedDictionaryType>(std::distance(std::begin(kDictionaryNames), found));
+    return true;
+}
+
+bool parsePixelFormat(const std::string &name, traact::vision::PixelFormat &pixel_format) {
+    using traact::vision::PixelFormat;
+    const std::pair<const char *, PixelFormat> formats[] = {
+        {"gray", PixelFormat::LUMINANCE}, {"rgb", PixelFormat::RGB}, {"bgr", PixelFormat::BGR},
+        {"rgba", PixelFormat::RGBA}, {"bgra", PixelFormat::BGRA}, {"yuyv", PixelFormat::YUV422}};
+    for (const auto &[format_name, format] : formats) {
+        if (name == format_name) {
+            pixel_format = format;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseFractalConfig(const std::string &name, ::aruco::FractalMarkerSet::CONF_TYPES &marker_config) {
+    using ConfType = ::aruco::FractalMarkerSet::CONF_TYPES;
+    const std::pair<const char *, ConfType> configs[] = {
+        {"FRACTAL_2L_6", ConfType::FRACTAL_2L_6}, {"FRACTAL_3L_6", ConfType::FRACTAL_3L_6},
+        {"FRACTAL_4L_6", ConfType::FRACTAL_4L_6}, {"FRACTAL_5L_6", ConfType::FRACTAL_5L_6}};
+    for (const auto &[config_name, config] : configs) {
+        if (name == config_name) {
+            marker_config = config;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ArucoVideoFast needs consecutive frames, the workers of the pipeline only see every n-th frame
+bool parseBackend(const std::string &name, DetectorBackendType &backend_type) {
+    const std::pair<const char *, DetectorBackendType> backends[] = {
+        {"OpenCV", DetectorBackendType::OPENCV}, {"ArucoFast", DetectorBackendType::ARUCO_FAST}};
+    for (const auto &[backend_name, backend] : backends) {
+        if (name == backend_name) {
+            backend_type = backend;
+            return true;
+        }
+    }
+    return false;
+}
+
+struct ReplayResult {
+    std::uint64_t frames{0};
+    double seconds{0};
+};
+
+/**
+ * Detection on all workers of a DetectionPipeline, poses are estimated and written in frame order on its emitter
+ * as in ArucoModule::StartPipeline
+ */
+void replayMarkers(FrameSource &source,
+                   const traact::vision::CameraCalibration &calibration,
+                   cv::aruco::PredefinedDictionaryType dictionary_type,
+                   DetectorBackendType backend_type,
+                   int first_id,
+                   int last_id,
+                   double marker_size,
+                   int threads,
+                   PoseTraceWriter &writer,
+                   ReplayResult &result) {
+    auto dictionary = cv::aruco::getPredefinedDictionary(dictionary_type);
+    first_id = std::max(0, first_id);
+    last_id = last_id < 0 ? dictionary.bytesList.rows - 1 : std::min(last_id, dictionary.bytesList.rows - 1);
+
+    ArucoModule module;
+    module.SetName("ArucoReplay");
+    module.SetDictionary(dictionary);
+    // the list output is never sent to, it only subscribes the id range to pose estimation
+    ArucoListOutputComponent list_output("replay_output");
+    list_output.SetIdRange(first_id, last_id);
+    module.AddListOutput(&list_output);
+
+    auto start = Clock::now();
+    {
+        DetectionPipeline pipeline(
+            threads, 2 * threads, DropPolicy::BLOCK,
+            [&dictionary, backend_type]() {
+                auto detector = std::make_unique<SquareMarkerDetector>(dictionary, cv::aruco::DetectorParameters(),
+                                                                       backend_type);
+                detector->setDecodeMode(DecodeMode::AUTO);
+                return detector;
+            },
+            [&module](PipelineFrame &pipeline_frame, SquareMarkerDetector &detector) {
+                module.DetectMarkers(pipeline_frame.image, detector, pipeline_frame.frame);
+            },
+            [&](PipelineFrame &pipeline_frame) {
+                auto &frame = pipeline_frame.frame;
+                module.EstimatePoses(pipeline_frame.image, pipeline_frame.calibration, pipeline_frame.marker_size,
+                                     frame);
+                auto timestamp = static_cast<std::int64_t>(pipeline_frame.ts.time_since_epoch().count());
+                for (std::size_t i = 0; i < frame.subscribed_marker_ids.size(); ++i) {
+                    if (!frame.solved[i]) {
+                        continue;
+                    }
+                    writer.append(timestamp, frame.subscribed_marker_ids[i], frame.subscribed_markers[i],
+                                  frame.r_vecs[i], frame.t_vecs[i]);
+                }
+                ++result.frames;
+            });
+
+        ReplayFrame replay_frame;
+        while (source.next(replay_frame)) {
+            auto pipeline_frame = std::make_unique<PipelineFrame>();
+            pipeline_frame->ts = traact::Timestamp(std::chrono::duration_cast<traact::Timestamp::duration>(
+                std::chrono::nanoseconds(replay_frame.timestamp)));
+            pipeline_frame->valid = true;
+            pipeline_frame->image = std::move(replay_frame.image);
+            pipeline_frame->calibration = calibration;
+            pipeline_frame->marker_size = marker_size;
+            pipeline.submit(std::move(pipeline_frame));
+        }
+        pipeline.stop();
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    module.Statistics().logSummary("ArucoReplay");
+}
+
+/**
+ * Batches of frames processed concurrently by FractalTracking without region tracking. Without tracking each frame
+ * is detected and solved on its own pooled detector and pose solver, so the poses do not depend on the thread
+ * count or on which frames were processed before. Results are kept per frame index and written in frame order after
+ * the batch, so the trace is identical for every thread count.
+ */
+void replayFractal(FrameSource &source,
+                   const traact::vision::CameraCalibration &calibration,
+                   ::aruco::FractalMarkerSet::CONF_TYPES marker_config,
+                   double marker_size,
+                   int threads,
+                   PoseTraceWriter &writer,
+                   ReplayResult &result) {
+    FractalTracking fractal_tracking;
+    fractal_tracking.setConfiguration(marker_config, marker_size);
+    fractal_tracking.setTracking(false, 1, 0);
+    ArucoStatistics statistics;
+
+    const auto half_size = static_cast<float>(marker_size / 2);
+    const std::vector<cv::Point3f> outer_corners{
+        {-half_size, half_size, 0}, {half_size, half_size, 0}, {half_size, -half_size, 0},
+        {-half_size, -half_size, 0}};
+
+    const std::size_t batch_size = 4 * static_cast<std::size_t>(threads);
+    std::vector<ReplayFrame> batch(batch_size);
+    std::vector<FractalResult> batch_results(batch_size);
+    std::vector<std::vector<cv::Point2f>> batch_corners(batch_size);
+
+    auto start = Clock::now();
+    bool more_frames{true};
+    while (more_frames) {
+        std::size_t batch_frames{0};
+        while (batch_frames < batch_size && (more_frames = source.next(batch[batch_frames]))) {
+            ++batch_frames;
+        }
+
+        cv::parallel_for_(cv::Range(0, static_cast<int>(batch_frames)), [&](const cv::Range &range) {
+            for (int i = range.start; i < range.end; ++i) {
+                auto &fractal_result = batch_results[i];
+                batch_corners[i].clear();
+                auto ts = traact::Timestamp(std::chrono::duration_cast<traact::Timestamp::duration>(
+                    std::chrono::nanoseconds(batch[i].timestamp)));
+                if (fractal_tracking.process(ts, batch[i].image, calibration, statistics, fractal_result)) {
+                    cv::projectPoints(outer_corners, fractal_result.r_vec, fractal_result.t_vec,
+                                      fractal_result.camera_matrix, fractal_result.distortion_coefficients,
+                                      batch_corners[i]);
+                }
+            }
+        }, threads);
+
+        for (std::size_t i = 0; i < batch_frames; ++i) {
+            if (batch_results[i].found) {
+                writer.append(batch[i].timestamp, kFractalMarkerId, batch_corners[i], batch_results[i].r_vec,
+                              batch_results[i].t_vec);
+            }
+            // mapped frames are released with the batch
+            batch[i].image.release();
+        }
+        result.frames += batch_frames;
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    statistics.logSummary("ArucoReplay fractal");
+}
+
+}
+
+int main(int argc, char **argv) {
+    const std::string keys =
+        "{help h         |              | print this message }"
+        "{@input         |              | raw frame file or video }"
+        "{@calibration   |              | camera calibration in OpenCV FileStorage format }"
+        "{@output        |              | pose trace to write }"
+        "{width          | 0            | width of raw frames, a video is read if 0 }"
+        "{height         | 0            | height of raw frames }"
+        "{format         | gray         | pixel format of raw frames: gray, rgb, bgr, rgba, bgra, yuyv }"
+        "{fps            | 30.0         | frame rate for timestamps of raw frames }"
+        "{mode           | marker       | marker or fractal }"
+        "{dictionary     | DICT_4X4_50  | predefined dictionary of square markers }"
+        "{backend        | OpenCV       | detector backend: OpenCV, ArucoFast }"
+        "{first_id       | 0            | first marker id written to the trace }"
+        "{last_id        | -1           | last marker id written to the trace, -1 for the whole dictionary }"
+        "{fractal_config | FRACTAL_2L_6 | fractal marker configuration }"
+        "{marker_size    | 0.08         | marker side length in meter }"
+        "{threads        | 0            | worker threads, 0 uses all cores }";
+    cv::CommandLineParser parser(argc, argv, keys);
+    parser.about("Offline replay of recorded frames through the traact aruco pipeline into a pose trace");
+    if (parser.has("help") || !parser.has("@output")) {
+        parser.printMessage();
+        return parser.has("help") ? 0 : 1;
+    }
+
+    FrameSourceConfig source_config;
+    source_config.filename = parser.get<std::string>("@input");
+    source_config.width = parser.get<int>("width");
+    source_config.height = parser.get<int>("height");
+    source_config.fps = parser.get<double>("fps");
+    if (!parsePixelFormat(parser.get<std::string>("format"), source_config.pixel_format)) {
+        std::fprintf(stderr, "unknown pixel format %s\n", parser.get<std::string>("format").c_str());
+        return 1;
+    }
+
+    traact::vision::CameraCalibration calibration;
+    if (!loadCalibration(parser.get<std::string>("@calibration"), calibration)) {
+        return 1;
+    }
+
+    auto source = openFrameSource(source_config);
+    if (!source) {
+        return 1;
+    }
+
+    PoseTraceWriter writer;
+    if (!writer.open(parser.get<std::string>("@output"))) {
+        return 1;
+    }
+
+    auto threads = parser.get<int>("threads");
+    if (threads <= 0) {
+        threads = std::max(1, cv::getNumberOfCPUs());
+    }
+    auto marker_size = parser.get<double>("marker_size");
+
+    ReplayResult result;
+    auto mode = parser.get<std::string>("mode");
+    if (mode == "marker") {
+        cv::aruco::PredefinedDictionaryType dictionary;
+        if (!parseDictionary(parser.get<std::string>("dictionary"), dictionary)) {
+            std::fprintf(stderr, "unknown dictionary %s\n", parser.get<std::string>("dictionary").c_str());
+            return 1;
+        }
+        DetectorBackendType backend_type;
+        if (!parseBackend(parser.get<std::string>("backend"), backend_type)) {
+            std::fprintf(stderr, "unknown detector backend %s\n", parser.get<std::string>("backend").c_str());
+            return 1;
+        }
+        if (!isDictionarySupported(backend_type, cv::aruco::getPredefinedDictionary(dictionary))) {
+            std::fprintf(stderr, "detector backend %s does not support dictionary %s\n",
+                         parser.get<std::string>("backend").c_str(), parser.get<std::string>("dictionary").c_str());
+            return 1;
+        }
+        replayMarkers(*source, calibration, dictionary, backend_type, parser.get<int>("first_id"),
+                      parser.get<int>("last_id"), marker_size, threads, writer, result);
+    } else if (mode == "fractal") {
+        ::aruco::FractalMarkerSet::CONF_TYPES marker_config;
+        if (!parseFractalConfig(parser.get<std::string>("fractal_config"), marker_config)) {
+            std::fprintf(stderr, "unknown fractal configuration %s\n",
+                         parser.get<std::string>("fractal_config").c_str());
+            return 1;
+        }
+        replayFractal(*source, calibration, marker_config, marker_size, threads, writer, result);
+    } else {
+        std::fprintf(stderr, "unknown mode %s\n", mode.c_str());
+        return 1;
+    }
+
+    if (!writer.close()) {
+        std::fprintf(stderr, "could not write %s\n", parser.get<std::string>("@output").c_str());
+        return 1;
+    }
+    std::printf("%llu frames in %.2fs, %.1f fps on %d threads, %llu trace rows\n",
+                static_cast<unsigned long long>(result.frames), result.seconds,
+                result.seconds > 0 ? result.frames / result.seconds : 0.0, threads,
+                static_cast<unsigned long long>(writer.rows()));
+    return 0;
+}
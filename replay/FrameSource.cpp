@@ -0,0 +1,199 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "FrameSource.h"
+#include "LumaImage.h"
+#include <traact/traact.h>
+#include <opencv2/imgproc.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cmath>
+
+namespace traact::component::aruco::replay {
+
+namespace {
+std::int64_t frameTimestamp(std::int64_t frame_index, double fps) {
+    return static_cast<std::int64_t>(std::llround(frame_index * 1e9 / fps));
+}
+}
+
+RawFrameSource::RawFrameSource(const FrameSourceConfig &config) : config_(config) {
+    using vision::PixelFormat;
+
+    switch (config_.pixel_format) {
+        case PixelFormat::LUMINANCE:cv_type_ = CV_8UC1;
+            break;
+        case PixelFormat::YUV422:cv_type_ = CV_8UC2;
+            break;
+        case PixelFormat::RGB:
+        case PixelFormat::BGR:cv_type_ = CV_8UC3;
+            break;
+        case PixelFormat::RGBA:
+        case PixelFormat::BGRA:cv_type_ = CV_8UC4;
+            break;
+        default: {
+            SPDLOG_ERROR("RawFrameSource unsupported pixel format of {0}", config_.filename);
+            return;
+        }
+    }
+    header_.width = config_.width;
+    header_.height = config_.height;
+    header_.pixel_format = config_.pixel_format;
+    header_.base_type = BaseType::UINT_8;
+    header_.channels = CV_MAT_CN(cv_type_);
+    header_.stride = config_.width;
+    frame_bytes_ = static_cast<std::size_t>(config_.width) * config_.height * CV_ELEM_SIZE(cv_type_);
+
+    auto file = ::open(config_.filename.c_str(), O_RDONLY);
+    if (file < 0) {
+        SPDLOG_ERROR("RawFrameSource could not open {0}", config_.filename);
+        return;
+    }
+    struct stat file_stat{};
+    if (::fstat(file, &file_stat) == 0 && file_stat.st_size > 0) {
+        size_ = static_cast<std::size_t>(file_stat.st_size);
+        auto *mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+        if (mapping == MAP_FAILED) {
+            SPDLOG_ERROR("RawFrameSource could not map {0}", config_.filename);
+            size_ = 0;
+        } else {
+            data_ = static_cast<const std::uint8_t *>(mapping);
+            // frames are read once front to back, let the kernel read ahead aggressively
+            ::madvise(mapping, size_, MADV_SEQUENTIAL);
+        }
+    }
+    // the mapping stays valid without the descriptor
+    ::close(file);
+
+    frame_count_ = frame_bytes_ == 0 ? 0 : static_cast<std::int64_t>(size_ / frame_bytes_);
+    if (data_ && size_ % frame_bytes_ != 0) {
+        SPDLOG_WARN("RawFrameSource {0} ends with a partial frame, it is ignored", config_.filename);
+    }
+}
+
+RawFrameSource::~RawFrameSource() {
+    if (data_) {
+        ::munmap(const_cast<std::uint8_t *>(data_), size_);
+    }
+}
+
+bool RawFrameSource::isOpen() const {
+    return data_ != nullptr && frame_count_ > 0;
+}
+
+bool RawFrameSource::next(ReplayFrame &frame) {
+    if (next_frame_ >= frame_count_) {
+        return false;
+    }
+    // the mapping is read only, consumers only read the image or convert it into a new buffer
+    cv::Mat mapped(config_.height, config_.width, cv_type_,
+                   const_cast<std::uint8_t *>(data_ + next_frame_ * frame_bytes_));
+    cv::Mat luma_buffer;
+    frame.image = extractLuma(mapped, header_, luma_buffer);
+    frame.timestamp = frameTimestamp(next_frame_, config_.fps);
+    ++next_frame_;
+    return true;
+}
+
+std::int64_t RawFrameSource::frameCount() const {
+    return frame_count_;
+}
+
+VideoFrameSource::VideoFrameSource(const FrameSourceConfig &config) : config_(config) {
+    capture_.open(config_.filename);
+    if (!capture_.isOpened()) {
+        SPDLOG_ERROR("VideoFrameSource could not open {0}", config_.filename);
+    }
+}
+
+bool VideoFrameSource::isOpen() const {
+    return capture_.isOpened();
+}
+
+bool VideoFrameSource::next(ReplayFrame &frame) {
+    if (!capture_.read(decoded_) || decoded_.empty()) {
+        return false;
+    }
+    if (decoded_.channels() == 1) {
+        frame.image = decoded_.clone();
+    } else {
+        // the OpenCV video backends decode into BGR
+        cv::cvtColor(decoded_, frame.image, cv::COLOR_BGR2GRAY);
+    }
+
+    auto position_ms = capture_.get(cv::CAP_PROP_POS_MSEC);
+    if (position_ms > 0 || next_frame_ == 0) {
+        frame.timestamp = static_cast<std::int64_t>(std::llround(position_ms * 1e6));
+    } else {
+        frame.timestamp = frameTimestamp(next_frame_, config_.fps);
+    }
+    ++next_frame_;
+    return true;
+}
+
+std::int64_t VideoFrameSource::frameCount() const {
+    auto count = capture_.get(cv::CAP_PROP_FRAME_COUNT);
+    return count > 0 ? static_cast<std::int64_t>(count) : -1;
+}
+
+std::unique_ptr<FrameSource> openFrameSource(const FrameSourceConfig &config) {
+    if (config.width > 0 && config.height > 0) {
+        auto source = std::make_unique<RawFrameSource>(config);
+        if (!source->isOpen()) {
+            return nullptr;
+        }
+        return source;
+    }
+
+    auto source = std::make_unique<VideoFrameSource>(config);
+    if (!source->isOpen()) {
+        return nullptr;
+    }
+    return source;
+}
+
+bool loadCalibration(const std::string &filename, vision::CameraCalibration &calibration) {
+    cv::FileStorage file(filename, cv::FileStorage::READ);
+    if (!file.isOpened()) {
+        SPDLOG_ERROR("loadCalibration could not open {0}", filename);
+        return false;
+    }
+
+    cv::Mat camera_matrix;
+    cv::Mat distortion_coefficients;
+    file["image_width"] >> calibration.width;
+    file["image_height"] >> calibration.height;
+    file["camera_matrix"] >> camera_matrix;
+    file["distortion_coefficients"] >> distortion_coefficients;
+    if (camera_matrix.rows != 3 || camera_matrix.cols != 3) {
+        SPDLOG_ERROR("loadCalibration {0} has no 3x3 camera_matrix", filename);
+        return false;
+    }
+    camera_matrix.convertTo(camera_matrix, CV_64F);
+    calibration.fx = static_cast<float>(camera_matrix.at<double>(0, 0));
+    calibration.skew = static_cast<float>(camera_matrix.at<double>(0, 1));
+    calibration.cx = static_cast<float>(camera_matrix.at<double>(0, 2));
+    calibration.fy = static_cast<float>(camera_matrix.at<double>(1, 1));
+    calibration.cy = static_cast<float>(camera_matrix.at<double>(1, 2));
+
+    // OpenCV order k1 k2 p1 p2 [k3 [k4 k5 k6]]
+    calibration.radial_distortion.clear();
+    calibration.tangential_distortion.clear();
+    if (distortion_coefficients.empty()) {
+        return true;
+    }
+    distortion_coefficients = distortion_coefficients.reshape(1, 1);
+    distortion_coefficients.convertTo(distortion_coefficients, CV_64F);
+    for (int i = 0; i < distortion_coefficients.cols && i < 8; ++i) {
+        auto value = static_cast<float>(distortion_coefficients.at<double>(i));
+        if (i == 2 || i == 3) {
+            calibration.tangential_distortion.push_back(value);
+        } else {
+            calibration.radial_distortion.push_back(value);
+        }
+    }
+    return true;
+}
+
+}
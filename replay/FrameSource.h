@@ -0,0 +1,117 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_REPLAY_FRAMESOURCE_H
+#define TRAACTMULTI_REPLAY_FRAMESOURCE_H
+
+#include <traact/vision.h>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace traact::component::aruco::replay {
+
+struct ReplayFrame {
+    /**
+     * nanoseconds since the start of the sequence
+     */
+    std::int64_t timestamp{0};
+    /**
+     * single channel 8 bit image, may reference the memory of the source
+     */
+    cv::Mat image;
+};
+
+struct FrameSourceConfig {
+    std::string filename;
+    /**
+     * raw sequences only, frames are stored back to back without header. Supported pixel formats are LUMINANCE,
+     * RGB, BGR, RGBA, BGRA and YUV422 (YUYV).
+     */
+    int width{0};
+    int height{0};
+    vision::PixelFormat pixel_format{vision::PixelFormat::LUMINANCE};
+    /**
+     * frame rate used for the timestamps of raw sequences, and of videos without timestamps
+     */
+    double fps{30.0};
+};
+
+/**
+ * Sequential frames of a recording, read by a single thread
+ */
+class FrameSource {
+ public:
+    virtual ~FrameSource() = default;
+
+    /**
+     * @return false at the end of the sequence
+     */
+    virtual bool next(ReplayFrame &frame) = 0;
+
+    /**
+     * @return number of frames, -1 if unknown
+     */
+    virtual std::int64_t frameCount() const = 0;
+};
+
+/**
+ * Memory mapped file of raw frames, luminance frames are passed on without a copy
+ */
+class RawFrameSource : public FrameSource {
+ public:
+    explicit RawFrameSource(const FrameSourceConfig &config);
+    RawFrameSource(const RawFrameSource &) = delete;
+    RawFrameSource &operator=(const RawFrameSource &) = delete;
+    ~RawFrameSource() override;
+
+    bool isOpen() const;
+    bool next(ReplayFrame &frame) override;
+    std::int64_t frameCount() const override;
+
+ private:
+    FrameSourceConfig config_;
+    vision::ImageHeader header_;
+    int cv_type_{CV_8UC1};
+    std::size_t frame_bytes_{0};
+    const std::uint8_t *data_{nullptr};
+    std::size_t size_{0};
+    std::int64_t frame_count_{0};
+    std::int64_t next_frame_{0};
+};
+
+/**
+ * Video file decoded by the OpenCV video backend
+ */
+class VideoFrameSource : public FrameSource {
+ public:
+    explicit VideoFrameSource(const FrameSourceConfig &config);
+
+    bool isOpen() const;
+    bool next(ReplayFrame &frame) override;
+    std::int64_t frameCount() const override;
+
+ private:
+    FrameSourceConfig config_;
+    cv::VideoCapture capture_;
+    cv::Mat decoded_;
+    std::int64_t next_frame_{0};
+};
+
+/**
+ * Raw sequence if width and height are set, a video otherwise
+ *
+ * @return nullptr if the file could not be opened
+ */
+std::unique_ptr<FrameSource> openFrameSource(const FrameSourceConfig &config);
+
+/**
+ * Camera calibration in OpenCV FileStorage format with the keys image_width, image_height, camera_matrix and
+ * distortion_coefficients as written by the OpenCV calibration sample
+ */
+bool loadCalibration(const std::string &filename, vision::CameraCalibration &calibration);
+
+}
+
+#endif //TRAACTMULTI_REPLAY_FRAMESOURCE_H
@@ -0,0 +1,189 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "PoseTrace.h"
+#include <traact/traact.h>
+#include <algorithm>
+#include <cstring>
+
+namespace traact::component::aruco::replay {
+
+namespace {
+constexpr char kMagic[4] = {'A', 'T', 'R', 'C'};
+
+template<typename T>
+void writeColumn(std::ofstream &file, const std::vector<T> &column) {
+    file.write(reinterpret_cast<const char *>(column.data()), static_cast<std::streamsize>(column.size() * sizeof(T)));
+}
+
+template<typename T>
+void swapByteOrder(T &value) {
+    auto *bytes = reinterpret_cast<char *>(&value);
+    std::reverse(bytes, bytes + sizeof(T));
+}
+
+template<typename T>
+bool readValue(std::ifstream &file, T &value, bool swap_byte_order) {
+    file.read(reinterpret_cast<char *>(&value), sizeof(T));
+    if (swap_byte_order) {
+        swapByteOrder(value);
+    }
+    return static_cast<bool>(file);
+}
+
+template<typename T>
+bool readColumn(std::ifstream &file, std::vector<T> &column, std::size_t count, bool swap_byte_order) {
+    auto offset = column.size();
+    column.resize(offset + count);
+    file.read(reinterpret_cast<char *>(column.data() + offset), static_cast<std::streamsize>(count * sizeof(T)));
+    if (swap_byte_order) {
+        std::for_each(column.begin() + offset, column.end(), swapByteOrder<T>);
+    }
+    return static_cast<bool>(file);
+}
+}
+
+std::size_t PoseTrace::size() const {
+    return timestamps.size();
+}
+
+void PoseTrace::clear() {
+    timestamps.clear();
+    marker_ids.clear();
+    corners.clear();
+    r_vecs.clear();
+    t_vecs.clear();
+}
+
+void PoseTrace::append(std::int64_t timestamp,
+                       std::int32_t marker_id,
+                       const std::vector<cv::Point2f> &marker_corners,
+                       const cv::Vec3d &r_vec,
+                       const cv::Vec3d &t_vec) {
+    timestamps.push_back(timestamp);
+    marker_ids.push_back(marker_id);
+    for (std::size_t i = 0; i < 4; ++i) {
+        // rows without corners (e.g. fractal markers that were not projected) are zero
+        auto corner = i < marker_corners.size() ? marker_corners[i] : cv::Point2f(0, 0);
+        corners.push_back(corner.x);
+        corners.push_back(corner.y);
+    }
+    r_vecs.insert(r_vecs.end(), r_vec.val, r_vec.val + 3);
+    t_vecs.insert(t_vecs.end(), t_vec.val, t_vec.val + 3);
+}
+
+cv::Vec3d PoseTrace::rVec(std::size_t row) const {
+    return {r_vecs[row * 3], r_vecs[row * 3 + 1], r_vecs[row * 3 + 2]};
+}
+
+cv::Vec3d PoseTrace::tVec(std::size_t row) const {
+    return {t_vecs[row * 3], t_vecs[row * 3 + 1], t_vecs[row * 3 + 2]};
+}
+
+const float *PoseTrace::rowCorners(std::size_t row) const {
+    return corners.data() + row * 8;
+}
+
+PoseTraceWriter::~PoseTraceWriter() {
+    close();
+}
+
+bool PoseTraceWriter::open(const std::string &filename) {
+    file_.open(filename, std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        SPDLOG_ERROR("PoseTraceWriter could not open {0}", filename);
+        return false;
+    }
+    file_.write(kMagic, sizeof(kMagic));
+    auto byte_order_mark = PoseTrace::kByteOrderMark;
+    file_.write(reinterpret_cast<const char *>(&byte_order_mark), sizeof(byte_order_mark));
+    auto version = PoseTrace::kVersion;
+    file_.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    block_.clear();
+    rows_ = 0;
+    return static_cast<bool>(file_);
+}
+
+void PoseTraceWriter::append(std::int64_t timestamp,
+                             std::int32_t marker_id,
+                             const std::vector<cv::Point2f> &marker_corners,
+                             const cv::Vec3d &r_vec,
+                             const cv::Vec3d &t_vec) {
+    block_.append(timestamp, marker_id, marker_corners, r_vec, t_vec);
+    ++rows_;
+    if (block_.size() >= PoseTrace::kBlockRows) {
+        writeBlock();
+    }
+}
+
+bool PoseTraceWriter::close() {
+    if (!file_.is_open()) {
+        return true;
+    }
+    writeBlock();
+    file_.close();
+    return !file_.fail();
+}
+
+std::uint64_t PoseTraceWriter::rows() const {
+    return rows_;
+}
+
+void PoseTraceWriter::writeBlock() {
+    if (block_.size() == 0) {
+        return;
+    }
+    auto row_count = static_cast<std::uint32_t>(block_.size());
+    file_.write(reinterpret_cast<const char *>(&row_count), sizeof(row_count));
+    writeColumn(file_, block_.timestamps);
+    writeColumn(file_, block_.marker_ids);
+    writeColumn(file_, block_.corners);
+    writeColumn(file_, block_.r_vecs);
+    writeColumn(file_, block_.t_vecs);
+    block_.clear();
+}
+
+bool readPoseTrace(const std::string &filename, PoseTrace &trace) {
+    trace.clear();
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) {
+        SPDLOG_ERROR("readPoseTrace could not open {0}", filename);
+        return false;
+    }
+
+    char magic[4];
+    std::uint32_t byte_order_mark{0};
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(&byte_order_mark), sizeof(byte_order_mark));
+    if (!file || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0) {
+        SPDLOG_ERROR("readPoseTrace {0} is no pose trace", filename);
+        return false;
+    }
+    auto swapped_byte_order_mark = byte_order_mark;
+    swapByteOrder(swapped_byte_order_mark);
+    if (byte_order_mark != PoseTrace::kByteOrderMark && swapped_byte_order_mark != PoseTrace::kByteOrderMark) {
+        SPDLOG_ERROR("readPoseTrace {0} has no valid byte order mark", filename);
+        return false;
+    }
+    const bool swap_byte_order = byte_order_mark != PoseTrace::kByteOrderMark;
+
+    std::uint32_t version{0};
+    if (!readValue(file, version, swap_byte_order) || version != PoseTrace::kVersion) {
+        SPDLOG_ERROR("readPoseTrace {0} is version {1}, expected {2}", filename, version, PoseTrace::kVersion);
+        return false;
+    }
+
+    std::uint32_t row_count;
+    while (readValue(file, row_count, swap_byte_order)) {
+        if (!readColumn(file, trace.timestamps, row_count, swap_byte_order)
+            || !readColumn(file, trace.marker_ids, row_count, swap_byte_order)
+            || !readColumn(file, trace.corners, row_count * 8, swap_byte_order)
+            || !readColumn(file, trace.r_vecs, row_count * 3, swap_byte_order)
+            || !readColumn(file, trace.t_vecs, row_count * 3, swap_byte_order)) {
+            SPDLOG_ERROR("readPoseTrace {0} is truncated after {1} rows", filename, trace.size());
+            return false;
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,83 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_REPLAY_POSETRACE_H
+#define TRAACTMULTI_REPLAY_POSETRACE_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace traact::component::aruco::replay {
+
+/**
+ * Detection results of a replay, one row per detected marker, stored by column.
+ *
+ * The file starts with the magic "ATRC", the uint32 kByteOrderMark and a uint32 version, followed by blocks of up
+ * to kBlockRows rows. Each block is a uint32 row count followed by the columns of its rows: int64 timestamps in
+ * nanoseconds, int32 marker ids, 8 float corner coordinates (x0 y0 ... x3 y3), 3 double rotation vector and
+ * 3 double translation vector values per row.
+ * Values are written in the byte order of the writer, given by the byte order mark. The reader swaps the values of
+ * traces written with the other byte order.
+ */
+struct PoseTrace {
+    static constexpr std::uint32_t kVersion = 2;
+    static constexpr std::uint32_t kByteOrderMark = 0x01020304;
+    static constexpr std::size_t kBlockRows = 4096;
+
+    std::vector<std::int64_t> timestamps;
+    std::vector<std::int32_t> marker_ids;
+    std::vector<float> corners;
+    std::vector<double> r_vecs;
+    std::vector<double> t_vecs;
+
+    std::size_t size() const;
+    void clear();
+    void append(std::int64_t timestamp,
+                std::int32_t marker_id,
+                const std::vector<cv::Point2f> &marker_corners,
+                const cv::Vec3d &r_vec,
+                const cv::Vec3d &t_vec);
+
+    cv::Vec3d rVec(std::size_t row) const;
+    cv::Vec3d tVec(std::size_t row) const;
+    const float *rowCorners(std::size_t row) const;
+};
+
+/**
+ * Writes rows block by block, memory stays bounded for traces of any length
+ */
+class PoseTraceWriter {
+ public:
+    PoseTraceWriter() = default;
+    PoseTraceWriter(const PoseTraceWriter &) = delete;
+    PoseTraceWriter &operator=(const PoseTraceWriter &) = delete;
+    ~PoseTraceWriter();
+
+    bool open(const std::string &filename);
+    void append(std::int64_t timestamp,
+                std::int32_t marker_id,
+                const std::vector<cv::Point2f> &marker_corners,
+                const cv::Vec3d &r_vec,
+                const cv::Vec3d &t_vec);
+    /**
+     * Write the pending rows and close the file
+     */
+    bool close();
+
+    std::uint64_t rows() const;
+
+ private:
+    void writeBlock();
+
+    std::ofstream file_;
+    PoseTrace block_;
+    std::uint64_t rows_{0};
+};
+
+bool readPoseTrace(const std::string &filename, PoseTrace &trace);
+
+}
+
+#endif //TRAACTMULTI_REPLAY_POSETRACE_H
@@ -0,0 +1,131 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "PoseTrace.h"
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+
+using namespace traact::component::aruco::replay;
+
+namespace {
+
+struct ErrorSummary {
+    double sum{0};
+    double max{0};
+    std::size_t count{0};
+
+    void add(double value) {
+        sum += value;
+        max = std::max(max, value);
+        ++count;
+    }
+    double mean() const {
+        return count == 0 ? 0.0 : sum / count;
+    }
+};
+
+double cornerError(const PoseTrace &a, std::size_t row_a, const PoseTrace &b, std::size_t row_b) {
+    const auto *corners_a = a.rowCorners(row_a);
+    const auto *corners_b = b.rowCorners(row_b);
+    double max_error{0};
+    for (std::size_t i = 0; i < 8; i += 2) {
+        max_error = std::max(max_error, std::hypot(corners_a[i] - corners_b[i], corners_a[i + 1] - corners_b[i + 1]));
+    }
+    return max_error;
+}
+
+double rotationErrorDeg(const cv::Vec3d &r_vec_a, const cv::Vec3d &r_vec_b) {
+    cv::Matx33d rotation_a;
+    cv::Matx33d rotation_b;
+    cv::Rodrigues(r_vec_a, rotation_a);
+    cv::Rodrigues(r_vec_b, rotation_b);
+    cv::Vec3d difference;
+    cv::Rodrigues(rotation_a.t() * rotation_b, difference);
+    return cv::norm(difference) * 180.0 / CV_PI;
+}
+
+}
+
+int main(int argc, char **argv) {
+    const std::string keys =
+        "{help h         |      | print this message }"
+        "{@a             |      | reference pose trace }"
+        "{@b             |      | compared pose trace }"
+        "{corner_px      | 0.5  | tolerated corner distance in pixel }"
+        "{translation_mm | 1.0  | tolerated translation distance in millimeter }"
+        "{rotation_deg   | 0.5  | tolerated rotation difference in degree }"
+        "{print          | 10   | differing rows printed }";
+    cv::CommandLineParser parser(argc, argv, keys);
+    parser.about("Compare two pose traces of aruco_replay row by row, matched by timestamp and marker id");
+    if (parser.has("help") || !parser.has("@b")) {
+        parser.printMessage();
+        return parser.has("help") ? 0 : 2;
+    }
+
+    PoseTrace a;
+    PoseTrace b;
+    if (!readPoseTrace(parser.get<std::string>("@a"), a) || !readPoseTrace(parser.get<std::string>("@b"), b)) {
+        return 2;
+    }
+
+    const auto corner_tolerance = parser.get<double>("corner_px");
+    const auto translation_tolerance = parser.get<double>("translation_mm");
+    const auto rotation_tolerance = parser.get<double>("rotation_deg");
+    auto rows_to_print = parser.get<int>("print");
+
+    // duplicated keys keep the first row, as ArucoModule only solves the first detection of an id
+    std::map<std::pair<std::int64_t, std::int32_t>, std::size_t> rows_b;
+    for (std::size_t row = 0; row < b.size(); ++row) {
+        rows_b.emplace(std::make_pair(b.timestamps[row], b.marker_ids[row]), row);
+    }
+
+    ErrorSummary corner_errors;
+    ErrorSummary translation_errors;
+    ErrorSummary rotation_errors;
+    std::size_t only_in_a{0};
+    std::size_t differing{0};
+    for (std::size_t row_a = 0; row_a < a.size(); ++row_a) {
+        auto found = rows_b.find(std::make_pair(a.timestamps[row_a], a.marker_ids[row_a]));
+        if (found == rows_b.end()) {
+            ++only_in_a;
+            if (rows_to_print-- > 0) {
+                std::printf("only in a: ts %lld id %d\n", static_cast<long long>(a.timestamps[row_a]),
+                            a.marker_ids[row_a]);
+            }
+            continue;
+        }
+        auto row_b = found->second;
+        rows_b.erase(found);
+
+        auto corner_error = cornerError(a, row_a, b, row_b);
+        auto translation_error = 1000.0 * cv::norm(a.tVec(row_a) - b.tVec(row_b));
+        auto rotation_error = rotationErrorDeg(a.rVec(row_a), b.rVec(row_b));
+        corner_errors.add(corner_error);
+        translation_errors.add(translation_error);
+        rotation_errors.add(rotation_error);
+
+        if (corner_error > corner_tolerance || translation_error > translation_tolerance
+            || rotation_error > rotation_tolerance) {
+            ++differing;
+            if (rows_to_print-- > 0) {
+                std::printf("differs: ts %lld id %d corner %.3fpx translation %.3fmm rotation %.3fdeg\n",
+                            static_cast<long long>(a.timestamps[row_a]), a.marker_ids[row_a],
+                            corner_error, translation_error, rotation_error);
+            }
+        }
+    }
+    auto only_in_b = rows_b.size();
+
+    std::printf("rows a %zu b %zu matched %zu only in a %zu only in b %zu differing %zu\n",
+                a.size(), b.size(), corner_errors.count, only_in_a, only_in_b, differing);
+    std::printf("%-16s %10s %10s\n", "error", "mean", "max");
+    std::printf("%-16s %10.4f %10.4f\n", "corner_px", corner_errors.mean(), corner_errors.max);
+    std::printf("%-16s %10.4f %10.4f\n", "translation_mm", translation_errors.mean(), translation_errors.max);
+    std::printf("%-16s %10.4f %10.4f\n", "rotation_deg", rotation_errors.mean(), rotation_errors.max);
+
+    return only_in_a == 0 && only_in_b == 0 && differing == 0 ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "ArucoModule.h"
+#include <rttr/registration>
+
+namespace traact::component::aruco {
+
+/**
+ * Pose of a marker board. output_inliers carries the image points consistent with the pose instead of only their
+ * count, the inlier count is the size of the list. It is only filled if the port is connected.
+ */
+class ArucoBoardOutput : public ArucoBoardOutputComponent {
+ public:
+    explicit ArucoBoardOutput(const std::string &name)
+        : ArucoBoardOutputComponent(name) {}
+
+    static traact::pattern::Pattern::Ptr GetPattern() {
+        using namespace traact::vision;
+        traact::pattern::Pattern::Ptr
+            pattern =
+            std::make_shared<traact::pattern::Pattern>("ArucoBoardOutput", Concurrency::SERIAL, ComponentType::INTERNAL_SYNC_SOURCE);
+
+        pattern->addProducerPort("output", spatial::Pose6DHeader::NativeTypeName);
+        pattern->addProducerPort("output_inliers", vision::Position2DListHeader::NativeTypeName);
+        pattern->addParameter("board_type", "Grid", {"Grid", "Charuco", "Custom"})
+            .addParameter("markers_x", 4)
+            .addParameter("markers_y", 3)
+            .addParameter("marker_length", 0.04)
+            .addParameter("marker_separation", 0.01)
+            .addParameter("squares_x", 5)
+            .addParameter("squares_y", 7)
+            .addParameter("square_length", 0.04)
+            .addParameter("first_marker_id", 0)
+            .addParameter("board_file", "")
+            .addParameter("reprojection_error", 3.0)
+            .addParameter("camera_group", "global");
+
+        return pattern;
+    }
+
+    bool configure(const pattern::instance::PatternInstance &pattern_instance, buffer::ComponentBufferConfig *data) override {
+        aruco_module_ = std::dynamic_pointer_cast<ArucoModule>(module_);
+
+        BoardType board_type;
+        pattern::setValueFromParameter(pattern_instance,
+                                       "board_type",
+                                       board_type,
+                                       "Grid",
+                                       {{"Grid", BoardType::GRID},
+                                        {"Charuco", BoardType::CHARUCO},
+                                        {"Custom", BoardType::CUSTOM}});
+        int markers_x, markers_y, squares_x, squares_y, first_marker_id;
+        double marker_length, marker_separation, square_length;
+        std::string board_file;
+        pattern::setValueFromParameter(pattern_instance, "markers_x", markers_x, 4);
+        pattern::setValueFromParameter(pattern_instance, "markers_y", markers_y, 3);
+        pattern::setValueFromParameter(pattern_instance, "marker_length", marker_length, 0.04);
+        pattern::setValueFromParameter(pattern_instance, "marker_separation", marker_separation, 0.01);
+        pattern::setValueFromParameter(pattern_instance, "squares_x", squares_x, 5);
+        pattern::setValueFromParameter(pattern_instance, "squares_y", squares_y, 7);
+        pattern::setValueFromParameter(pattern_instance, "square_length", square_length, 0.04);
+        pattern::setValueFromParameter(pattern_instance, "first_marker_id", first_marker_id, 0);
+        pattern::setValueFromParameter(pattern_instance, "board_file", board_file, "");
+        pattern::setValueFromParameter(pattern_instance, "reprojection_error", reprojection_error_, 3.0);
+
+        switch (board_type) {
+            case BoardType::GRID:
+                layout_.setGrid(markers_x, markers_y, static_cast<float>(marker_length),
+                                static_cast<float>(marker_separation), first_marker_id);
+                break;
+            case BoardType::CHARUCO:
+                layout_.setCharuco(squares_x, squares_y, static_cast<float>(square_length),
+                                   static_cast<float>(marker_length), first_marker_id);
+                break;
+            case BoardType::CUSTOM:
+                if (!layout_.loadCustom(board_file)) {
+                    return false;
+                }
+                break;
+        }
+
+        aruco_module_->AddBoardOutput(this);
+        return true;
+    }
+
+};
+
+CREATE_TRAACT_COMPONENT_FACTORY(ArucoBoardOutput)
+
+}
+
+BEGIN_TRAACT_PLUGIN_REGISTRATION
+    REGISTER_DEFAULT_COMPONENT(traact::component::aruco::ArucoBoardOutput)
+END_TRAACT_PLUGIN_REGISTRATION
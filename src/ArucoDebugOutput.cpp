@@ -15,12 +15,17 @@ class ArucoDebugOutput : public ArucoDebugOutputComponent {
             std::make_shared<traact::pattern::Pattern>("ArucoDebugOutput", Concurrency::SERIAL, ComponentType::INTERNAL_SYNC_SOURCE);
 
         pattern->addProducerPort("output", vision::ImageHeader::NativeTypeName);
+        pattern->addParameter("debug_rate", 1);
+        pattern->addParameter("draw_rejected", false);
+        pattern->addParameter("camera_group", "global");
 
         return pattern;
     }
 
     bool configure(const pattern::instance::PatternInstance &pattern_instance, buffer::ComponentBufferConfig *data) override {
         aruco_module_ = std::dynamic_pointer_cast<ArucoModule>(module_);
+        pattern::setValueFromParameter(pattern_instance, "debug_rate", debug_rate_, 1);
+        pattern::setValueFromParameter(pattern_instance, "draw_rejected", draw_rejected_, false);
         aruco_module_->SetDebugOutput(this);
         return true;
     }
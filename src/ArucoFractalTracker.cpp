@@ -6,6 +6,11 @@
 #include <fractaldetector.h>
 #include <aruco_cvversioning.h>
 #include <traact/opencv/OpenCVUtils.h>
+#include "FractalTracking.h"
+#include "SquareMarkerDetector.h"
+#include "ArucoStatistics.h"
+#include "LumaImage.h"
+#include <opencv2/calib3d.hpp>
 
 namespace traact::component::aruco {
 
@@ -20,7 +25,7 @@ class ArucoFractalTracker : public Component {
     using OutPortDebugImage = traact::buffer::PortConfig<vision::ImageHeader, 3>;
 
     ArucoFractalTracker(const std::string &name)
-        : Component(name) {}
+        : Component(name), luma_extractor_("ArucoFractalTracker " + name) {}
 
     static traact::pattern::Pattern::Ptr GetPattern() {
         using namespace traact::vision;
@@ -38,7 +43,12 @@ class ArucoFractalTracker : public Component {
             .addProducerPort<OutPortDebugImage>("output_debug_image")
             .addParameter("marker_config", "FRACTAL_2L_6",
                           {"FRACTAL_2L_6", "FRACTAL_3L_6", "FRACTAL_4L_6", "FRACTAL_5L_6",})
-            .addParameter("marker_size", 0.08);
+            .addParameter("marker_size", 0.08)
+            .addParameter("debug_rate", 1)
+            .addParameter("statistics_interval", 0)
+            .addParameter("tracking_mode", "FullFrame", {"FullFrame", "Roi"})
+            .addParameter("keyframe_interval", 30)
+            .addParameter("roi_padding", 0.5);
 
         return pattern;
     }
@@ -59,80 +69,83 @@ class ArucoFractalTracker : public Component {
                                        });
 
         pattern::setValueFromParameter(pattern_instance, "marker_size", marker_size_, 0.10);
+        pattern::setValueFromParameter(pattern_instance, "debug_rate", debug_rate_, 1);
+        pattern::setValueFromParameter(pattern_instance, "statistics_interval", statistics_interval_, 0);
+
+        TrackingMode tracking_mode;
+        int keyframe_interval;
+        double roi_padding;
+        pattern::setValueFromParameter(pattern_instance,
+                                       "tracking_mode",
+                                       tracking_mode,
+                                       "FullFrame",
+                                       {{"FullFrame", TrackingMode::FULL_FRAME},
+                                        {"Roi", TrackingMode::ROI}});
+        pattern::setValueFromParameter(pattern_instance, "keyframe_interval", keyframe_interval, 30);
+        pattern::setValueFromParameter(pattern_instance, "roi_padding", roi_padding, 0.5);
 
         marker_config_ = config;
+        tracking_.setConfiguration(marker_config_, marker_size_);
+        tracking_.setTracking(tracking_mode == TrackingMode::ROI, keyframe_interval, roi_padding);
         return true;
     }
 
+    bool stop() override {
+        SPDLOG_INFO("ArucoFractalTracker {0} detector pool hits {1} misses {2}",
+                    getName(),
+                    tracking_.detectorPool().hits(),
+                    tracking_.detectorPool().misses());
+        SPDLOG_INFO("ArucoFractalTracker {0} keyframes {1} region frames {2} lost tracks {3} out of order frames {4}",
+                    getName(),
+                    tracking_.keyframes(),
+                    tracking_.regionFrames(),
+                    tracking_.lostTracks(),
+                    tracking_.outOfOrderFrames());
+        statistics_.logSummary("ArucoFractalTracker " + getName());
+        return Component::stop();
+    }
+
     bool processTimePoint(traact::buffer::ComponentBuffer &data) override {
         using namespace traact::vision;
-        const auto input_image = data.getInput<InPortImage>().value();
+        // concurrent time points, each thread converts into its own buffer
+        thread_local cv::Mat luma_buffer;
+        auto input_image = luma_extractor_.extract(data.getInput<InPortImage>().value(),
+                                                   data.getInputHeader<InPortImage>(),
+                                                   luma_buffer);
+        if (input_image.empty()) {
+            // unusable input, logged once by the extractor, no outputs are written as for a missing input
+            return true;
+        }
         const auto &input_calibration = data.getInput<InPortCalibration>();
 
         SPDLOG_TRACE("ArucoFractalModule TrackMarker");
 
-        cv::Mat cameraMatrix;
-        cv::Mat distortionCoefficientsMatrix;
-        traact2cv(input_calibration, cameraMatrix, distortionCoefficientsMatrix);
-
-        auto dcm = distortionCoefficientsMatrix;
-        // aruco can only handle distortion coefficients with 4-7 elements, opencv requires 4/5/8, azure kinect provides 8
-        // for now only take 5 (3 radial, 2 tangential) parameters
-        if (input_calibration.radial_distortion.size() > 3)
-            dcm = distortionCoefficientsMatrix(cv::Range(0, 5), cv::Range(0, 1));
-
-        ::aruco::CameraParameters CamParam;
-        CamParam.setParams(cameraMatrix, dcm, cv::Size(input_calibration.width, input_calibration.height));
-
-        ::aruco::FractalDetector FractalDetector;
-        FractalDetector.setConfiguration(marker_config_);
+        FractalResult result;
+        tracking_.process(data.getTimestamp(), input_image, input_calibration, statistics_, result);
 
-        if (CamParam.isValid()) {
-            CamParam.resize(input_image.size());
-            FractalDetector.setParams(CamParam, static_cast<float>(marker_size_));
-        }
-
-        std::vector<::aruco::Marker> detected_markers;
-        std::vector<int> marker_ids;
-
-        FractalDetector.detect(input_image);
-        bool found_marker{false};
-
-        if (FractalDetector.poseEstimation()) {
+        if (result.found) {
             if (connected_output_ports_[OutPortPose::PortIdx]) {
-                auto r_vec = FractalDetector.getRvec();
-                auto t_vec = FractalDetector.getTvec();
                 auto &output = data.getOutput<OutPortPose>();
-                cv2traact(r_vec, t_vec, output);
+                cv2traact(result.r_vec, result.t_vec, output);
             }
             if (connected_output_ports_[OutPortPosition2D::PortIdx]) {
                 auto &output = data.getOutput<OutPortPosition2D>();
-                output = FractalDetector.getPoints2d(input_image);
+                output = result.points_2d;
             }
             if (connected_output_ports_[OutPortPosition3D::PortIdx]) {
                 auto &output = data.getOutput<OutPortPosition3D>();
-                output = FractalDetector.getPoints3d(input_image);
+                output = result.points_3d;
             }
-            found_marker = true;
         }
 
         // pose could be detected
+        // only rendered if a viewer is connected to the port
         if (connected_output_ports_[OutPortDebugImage::PortIdx]) {
-            auto &debug_image = data.getOutput<OutPortDebugImage>().value();
-            auto& debug_image_header = data.getOutputHeader<OutPortDebugImage>();
-            debug_image_header.width = input_image.cols;
-            debug_image_header.height = input_image.rows;
-            debug_image_header.pixel_format = PixelFormat::RGB;
-            debug_image_header.base_type = BaseType::UINT_8;
-            debug_image_header.channels = 3;
-            debug_image_header.stride = debug_image_header.width;
-            cv::cvtColor(input_image, debug_image, cv::COLOR_GRAY2RGB);
-
-            if (found_marker) {
-                FractalDetector.draw3d(debug_image);
-            } else {
-                FractalDetector.draw2d(debug_image);
-            }
+            writeDebugImage(data, input_image, result);
+        }
+
+        if (statistics_.frameDone(statistics_interval_)) {
+            statistics_.logSummary("ArucoFractalTracker " + getName());
         }
 
         return true;
@@ -140,9 +153,55 @@ class ArucoFractalTracker : public Component {
 
 
  private:
+    void writeDebugImage(traact::buffer::ComponentBuffer &data, const cv::Mat &input_image, const FractalResult &result) {
+        using namespace traact::vision;
+        auto &debug_image = data.getOutput<OutPortDebugImage>().value();
+        auto& debug_image_header = data.getOutputHeader<OutPortDebugImage>();
+        // the debug image shares the buffer with the other outputs and can not be sent as invalid on its own,
+        // skipped frames carry an empty image with an empty header instead of the image of an older frame
+        if (!shouldRenderDebug()) {
+            debug_image_header.width = 0;
+            debug_image_header.height = 0;
+            debug_image_header.stride = 0;
+            debug_image.release();
+            return;
+        }
+
+        StageTimer timer(statistics_, ArucoStage::DEBUG_RENDERING);
+        debug_image_header.width = input_image.cols;
+        debug_image_header.height = input_image.rows;
+        debug_image_header.pixel_format = PixelFormat::RGB;
+        debug_image_header.base_type = BaseType::UINT_8;
+        debug_image_header.channels = 3;
+        debug_image_header.stride = debug_image_header.width;
+        cv::cvtColor(input_image, debug_image, cv::COLOR_GRAY2RGB);
+
+        // the marker may have been found by the region detector, draw from the result
+        if (!result.level_corners.empty()) {
+            cv::aruco::drawDetectedMarkers(debug_image, result.level_corners, result.level_ids);
+        }
+        if (result.found) {
+            cv::drawFrameAxes(debug_image, result.camera_matrix, result.distortion_coefficients,
+                              result.r_vec, result.t_vec, static_cast<float>(marker_size_ / 2));
+        }
+    }
+
+    bool shouldRenderDebug() {
+        if (debug_rate_ <= 0) {
+            return false;
+        }
+        return debug_frame_count_.fetch_add(1, std::memory_order_relaxed) % debug_rate_ == 0;
+    }
+
     ::aruco::FractalMarkerSet::CONF_TYPES marker_config_;
     double marker_size_;
     pattern::instance::LocalConnectedOutputPorts connected_output_ports_;
+    FractalTracking tracking_;
+    LumaExtractor luma_extractor_;
+    int debug_rate_{1};
+    std::atomic<std::uint64_t> debug_frame_count_{0};
+    ArucoStatistics statistics_;
+    int statistics_interval_{0};
 
 };
 
@@ -1,6 +1,7 @@
 /** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
 
 #include "ArucoModule.h"
+#include "LumaImage.h"
 
 
 namespace traact::component::aruco {
@@ -10,7 +11,7 @@ class ArucoInput : public ArucoComponent {
     using InPortImage = buffer::PortConfig<vision::ImageHeader, 0>;
     using InPortCalibration = buffer::PortConfig<vision::CameraCalibrationHeader, 1>;
     ArucoInput(const std::string &name)
-        : ArucoComponent(name, ComponentType::SYNC_SINK, ModuleType::GLOBAL) {}
+        : ArucoComponent(name, ComponentType::SYNC_SINK, ModuleType::GLOBAL), luma_extractor_("ArucoInput " + name) {}
 
     static traact::pattern::Pattern::Ptr GetPattern() {
         using namespace traact::vision;
@@ -20,48 +21,309 @@ class ArucoInput : public ArucoComponent {
 
         pattern->addConsumerPort<InPortImage>("input")
             .addConsumerPort<InPortCalibration>("input_calibration")
-            .addParameter("dictionary", "DICT_4X4_50", {"DICT_4X4_50", "DICT_5X5_50", "DICT_6X6_50"})
-            .addParameter("marker_size", 0.08);
+            .addParameter("camera_group", "global")
+            .addParameter("dictionary", "DICT_4X4_50",
+                          {"DICT_4X4_50", "DICT_4X4_100", "DICT_4X4_250", "DICT_4X4_1000", "DICT_5X5_50",
+                           "DICT_5X5_100", "DICT_5X5_250", "DICT_5X5_1000", "DICT_6X6_50", "DICT_6X6_100",
+                           "DICT_6X6_250", "DICT_6X6_1000", "DICT_7X7_50", "DICT_7X7_100", "DICT_7X7_250",
+                           "DICT_7X7_1000", "DICT_ARUCO_ORIGINAL", "DICT_APRILTAG_16h5", "DICT_APRILTAG_25h9",
+                           "DICT_APRILTAG_36h10", "DICT_APRILTAG_36h11", "DICT_ARUCO_MIP_36h12"})
+            .addParameter("dictionary_file", "")
+            .addParameter("decode_mode", "Auto", {"Auto", "OpenCV", "Lookup"})
+            .addParameter("detector_backend", "OpenCV", {"OpenCV", "ArucoFast", "ArucoVideoFast"})
+            .addParameter("marker_size", 0.08)
+            .addParameter("decimation", 1)
+            .addParameter("min_marker_pixels", 0)
+            .addParameter("tile_size", 0)
+            .addParameter("tile_overlap", 0)
+            .addParameter("tracking_mode", "FullFrame", {"FullFrame", "Roi"})
+            .addParameter("full_search_interval", 30)
+            .addParameter("roi_padding", 0.5)
+            .addParameter("temporal_refine", true)
+            .addParameter("motion_filter", "None", {"None", "ConstantVelocity", "ConstantAcceleration"})
+            .addParameter("prediction_horizon_ms", 0.0)
+            .addParameter("max_dropout_ms", 0.0)
+            .addParameter("translation_process_noise", 1.0)
+            .addParameter("rotation_process_noise", 10.0)
+            .addParameter("translation_measurement_noise", 0.002)
+            .addParameter("rotation_measurement_noise", 0.02)
+            .addParameter("adaptive_thresh_win_size_min", 3)
+            .addParameter("adaptive_thresh_win_size_max", 23)
+            .addParameter("adaptive_thresh_win_size_step", 10)
+            .addParameter("min_marker_perimeter_rate", 0.03)
+            .addParameter("max_marker_perimeter_rate", 4.0)
+            .addParameter("corner_refinement", "None", {"None", "Subpix", "Contour", "AprilTag"})
+            .addParameter("auto_tune_budget_ms", 0.0)
+            .addParameter("auto_tune_file", "")
+            .addParameter("statistics_interval", 0)
+            .addParameter("pipeline_workers", 0)
+            .addParameter("max_frames_in_flight", 4)
+            .addParameter("drop_policy", "Block", {"Block", "DropNewest", "DropOldest"});
         return pattern;
     }
 
     bool configure(const pattern::instance::PatternInstance &pattern_instance, buffer::ComponentBufferConfig *data) override {
         aruco_module_ = std::dynamic_pointer_cast<ArucoModule>(module_);
+        aruco_module_->SetName("ArucoModule " + camera_group_);
         cv::aruco::PredefinedDictionaryType dict;
 
         pattern::setValueFromParameter(pattern_instance,
                                        "dictionary",
                                        dict,
                                        "DICT_4X4_50",
-                                       {{"DICT_4X4_50", cv::aruco::DICT_4X4_50},
+                                       {
+                                        {"DICT_4X4_50", cv::aruco::DICT_4X4_50},
+                                        {"DICT_4X4_100", cv::aruco::DICT_4X4_100},
+                                        {"DICT_4X4_250", cv::aruco::DICT_4X4_250},
+                                        {"DICT_4X4_1000", cv::aruco::DICT_4X4_1000},
                                         {"DICT_5X5_50", cv::aruco::DICT_5X5_50},
-                                        {"DICT_6X6_50", cv::aruco::DICT_6X6_50}});
+                                        {"DICT_5X5_100", cv::aruco::DICT_5X5_100},
+                                        {"DICT_5X5_250", cv::aruco::DICT_5X5_250},
+                                        {"DICT_5X5_1000", cv::aruco::DICT_5X5_1000},
+                                        {"DICT_6X6_50", cv::aruco::DICT_6X6_50},
+                                        {"DICT_6X6_100", cv::aruco::DICT_6X6_100},
+                                        {"DICT_6X6_250", cv::aruco::DICT_6X6_250},
+                                        {"DICT_6X6_1000", cv::aruco::DICT_6X6_1000},
+                                        {"DICT_7X7_50", cv::aruco::DICT_7X7_50},
+                                        {"DICT_7X7_100", cv::aruco::DICT_7X7_100},
+                                        {"DICT_7X7_250", cv::aruco::DICT_7X7_250},
+                                        {"DICT_7X7_1000", cv::aruco::DICT_7X7_1000},
+                                        {"DICT_ARUCO_ORIGINAL", cv::aruco::DICT_ARUCO_ORIGINAL},
+                                        {"DICT_APRILTAG_16h5", cv::aruco::DICT_APRILTAG_16h5},
+                                        {"DICT_APRILTAG_25h9", cv::aruco::DICT_APRILTAG_25h9},
+                                        {"DICT_APRILTAG_36h10", cv::aruco::DICT_APRILTAG_36h10},
+                                        {"DICT_APRILTAG_36h11", cv::aruco::DICT_APRILTAG_36h11},
+                                        {"DICT_ARUCO_MIP_36h12", cv::aruco::DICT_ARUCO_MIP_36h12}
+                                       });
         pattern::setValueFromParameter(pattern_instance, "marker_size", marker_size_, 0.08);
 
+        int decimation;
+        int min_marker_pixels;
+        pattern::setValueFromParameter(pattern_instance, "decimation", decimation, 1);
+        pattern::setValueFromParameter(pattern_instance, "min_marker_pixels", min_marker_pixels, 0);
+
+        int tile_size;
+        int tile_overlap;
+        pattern::setValueFromParameter(pattern_instance, "tile_size", tile_size, 0);
+        pattern::setValueFromParameter(pattern_instance, "tile_overlap", tile_overlap, 0);
+
+        TrackingMode tracking_mode;
+        int full_search_interval;
+        double roi_padding;
+        pattern::setValueFromParameter(pattern_instance,
+                                       "tracking_mode",
+                                       tracking_mode,
+                                       "FullFrame",
+                                       {{"FullFrame", TrackingMode::FULL_FRAME},
+                                        {"Roi", TrackingMode::ROI}});
+        pattern::setValueFromParameter(pattern_instance, "full_search_interval", full_search_interval, 30);
+        pattern::setValueFromParameter(pattern_instance, "roi_padding", roi_padding, 0.5);
+
+        std::string dictionary_file;
+        pattern::setValueFromParameter(pattern_instance, "dictionary_file", dictionary_file, "");
         auto dictionary = cv::aruco::getPredefinedDictionary(dict);
+        if (!dictionary_file.empty()) {
+            // custom dictionary as written by cv::aruco::Dictionary::writeDictionary
+            cv::FileStorage file(dictionary_file, cv::FileStorage::READ);
+            if (!file.isOpened() || !dictionary.readDictionary(file.root())) {
+                SPDLOG_ERROR("ArucoInput could not read dictionary file {0}", dictionary_file);
+                return false;
+            }
+        }
+
+        DecodeMode decode_mode;
+        pattern::setValueFromParameter(pattern_instance,
+                                       "decode_mode",
+                                       decode_mode,
+                                       "Auto",
+                                       {{"Auto", DecodeMode::AUTO},
+                                        {"OpenCV", DecodeMode::OPENCV},
+                                        {"Lookup", DecodeMode::LOOKUP}});
+
+        DetectorBackendType backend_type;
+        pattern::setValueFromParameter(pattern_instance,
+                                       "detector_backend",
+                                       backend_type,
+                                       "OpenCV",
+                                       {{"OpenCV", DetectorBackendType::OPENCV},
+                                        {"ArucoFast", DetectorBackendType::ARUCO_FAST},
+                                        {"ArucoVideoFast", DetectorBackendType::ARUCO_VIDEO_FAST}});
+
+        aruco_module_->SetDictionary(dictionary);
+
         auto parameter = cv::aruco::DetectorParameters();
+        pattern::setValueFromParameter(pattern_instance, "adaptive_thresh_win_size_min",
+                                       parameter.adaptiveThreshWinSizeMin, 3);
+        pattern::setValueFromParameter(pattern_instance, "adaptive_thresh_win_size_max",
+                                       parameter.adaptiveThreshWinSizeMax, 23);
+        pattern::setValueFromParameter(pattern_instance, "adaptive_thresh_win_size_step",
+                                       parameter.adaptiveThreshWinSizeStep, 10);
+        pattern::setValueFromParameter(pattern_instance, "min_marker_perimeter_rate",
+                                       parameter.minMarkerPerimeterRate, 0.03);
+        pattern::setValueFromParameter(pattern_instance, "max_marker_perimeter_rate",
+                                       parameter.maxMarkerPerimeterRate, 4.0);
+        cv::aruco::CornerRefineMethod corner_refinement;
+        pattern::setValueFromParameter(pattern_instance,
+                                       "corner_refinement",
+                                       corner_refinement,
+                                       "None",
+                                       {{"None", cv::aruco::CORNER_REFINE_NONE},
+                                        {"Subpix", cv::aruco::CORNER_REFINE_SUBPIX},
+                                        {"Contour", cv::aruco::CORNER_REFINE_CONTOUR},
+                                        {"AprilTag", cv::aruco::CORNER_REFINE_APRILTAG}});
+        parameter.cornerRefinementMethod = corner_refinement;
+
+        double auto_tune_budget_ms;
+        std::string auto_tune_file;
+        pattern::setValueFromParameter(pattern_instance, "auto_tune_budget_ms", auto_tune_budget_ms, 0.0);
+        pattern::setValueFromParameter(pattern_instance, "auto_tune_file", auto_tune_file, "");
+        auto tuned = auto_tune_budget_ms > 0 && DetectorAutoTuner::load(auto_tune_file, parameter);
+        if (tuned) {
+            SPDLOG_INFO("ArucoInput {0} using tuned detector parameters of {1}", getName(), auto_tune_file);
+        }
+
+        pattern::setValueFromParameter(pattern_instance, "pipeline_workers", pipeline_workers_, 0);
+        pattern::setValueFromParameter(pattern_instance, "max_frames_in_flight", max_frames_in_flight_, 4);
+        pattern::setValueFromParameter(pattern_instance,
+                                       "drop_policy",
+                                       drop_policy_,
+                                       "Block",
+                                       {{"Block", DropPolicy::BLOCK},
+                                        {"DropNewest", DropPolicy::DROP_NEWEST},
+                                        {"DropOldest", DropPolicy::DROP_OLDEST}});
+        if (pipeline_workers_ > 0) {
+            // every worker only sees some of the frames, regions of interest from its last frame are not reliable
+            if (tracking_mode == TrackingMode::ROI) {
+                SPDLOG_WARN("ArucoInput {0} tracking_mode Roi is not supported with pipeline_workers, using FullFrame",
+                            getName());
+                tracking_mode = TrackingMode::FULL_FRAME;
+            }
+            if (backend_type == DetectorBackendType::ARUCO_VIDEO_FAST) {
+                SPDLOG_WARN("ArucoInput {0} detector_backend ArucoVideoFast is not supported with pipeline_workers, "
+                            "using ArucoFast", getName());
+                backend_type = DetectorBackendType::ARUCO_FAST;
+            }
+            if (auto_tune_budget_ms > 0 && !tuned) {
+                SPDLOG_WARN("ArucoInput {0} auto tuning is not supported with pipeline_workers", getName());
+                auto_tune_budget_ms = 0;
+            }
+        }
 
-        detector_ = std::make_unique<cv::aruco::ArucoDetector>(dictionary, parameter);
+        // the aruco library decodes with its own dictionaries, falling back would silently change the backend
+        if (!isDictionarySupported(backend_type, dictionary)) {
+            SPDLOG_ERROR("ArucoInput {0} detector_backend does not support the dictionary, use the OpenCV backend or "
+                         "ARUCO_ORIGINAL, an AprilTag or the ARUCO_MIP_36h12 dictionary", getName());
+            return false;
+        }
+
+        detector_factory_ = [=]() {
+            auto detector = std::make_unique<SquareMarkerDetector>(dictionary, parameter, backend_type);
+            detector->setTracking(tracking_mode, full_search_interval, roi_padding);
+            detector->setDecimation(decimation, min_marker_pixels);
+            detector->setTiling(tile_size, tile_overlap);
+            detector->setDecodeMode(decode_mode);
+            return detector;
+        };
+        detector_ = detector_factory_();
+        if (auto_tune_budget_ms > 0 && !tuned) {
+            detector_->setAutoTuner(std::make_unique<DetectorAutoTuner>(parameter, auto_tune_budget_ms,
+                                                                        auto_tune_file));
+        }
+
+        bool temporal_refine;
+        pattern::setValueFromParameter(pattern_instance, "temporal_refine", temporal_refine, true);
+        aruco_module_->SetTemporalRefine(temporal_refine);
+
+        MotionFilterConfig motion_filter;
+        MotionModel motion_model;
+        double prediction_horizon_ms;
+        double max_dropout_ms;
+        pattern::setValueFromParameter(pattern_instance,
+                                       "motion_filter",
+                                       motion_model,
+                                       "None",
+                                       {{"None", MotionModel::NONE},
+                                        {"ConstantVelocity", MotionModel::CONSTANT_VELOCITY},
+                                        {"ConstantAcceleration", MotionModel::CONSTANT_ACCELERATION}});
+        pattern::setValueFromParameter(pattern_instance, "prediction_horizon_ms", prediction_horizon_ms, 0.0);
+        pattern::setValueFromParameter(pattern_instance, "max_dropout_ms", max_dropout_ms, 0.0);
+        pattern::setValueFromParameter(pattern_instance,
+                                       "translation_process_noise",
+                                       motion_filter.translation_process_noise,
+                                       1.0);
+        pattern::setValueFromParameter(pattern_instance,
+                                       "rotation_process_noise",
+                                       motion_filter.rotation_process_noise,
+                                       10.0);
+        pattern::setValueFromParameter(pattern_instance,
+                                       "translation_measurement_noise",
+                                       motion_filter.translation_measurement_noise,
+                                       0.002);
+        pattern::setValueFromParameter(pattern_instance,
+                                       "rotation_measurement_noise",
+                                       motion_filter.rotation_measurement_noise,
+                                       0.02);
+        motion_filter.model = motion_model;
+        motion_filter.prediction_horizon = prediction_horizon_ms / 1000.0;
+        motion_filter.max_dropout = max_dropout_ms / 1000.0;
+        aruco_module_->SetMotionFilter(motion_filter);
+
+        int statistics_interval;
+        pattern::setValueFromParameter(pattern_instance, "statistics_interval", statistics_interval, 0);
+        aruco_module_->SetStatisticsInterval(statistics_interval);
 
         return true;
     }
 
+    bool start() override {
+        if (pipeline_workers_ > 0) {
+            aruco_module_->StartPipeline(pipeline_workers_, max_frames_in_flight_, drop_policy_, detector_factory_);
+        }
+        return ArucoComponent::start();
+    }
+
+    bool stop() override {
+        aruco_module_->StopPipeline();
+        return ArucoComponent::stop();
+    }
+
     bool processTimePoint(traact::buffer::ComponentBuffer &data) override {
         using namespace traact::vision;
-        const auto &input_image = data.getInput<InPortImage>().value();
+        auto input_image = luma_extractor_.extract(data.getInput<InPortImage>().value(),
+                                                   data.getInputHeader<InPortImage>(),
+                                                   luma_buffer_);
+        if (input_image.empty()) {
+            return processTimePointWithInvalid(data);
+        }
         const auto &input_calibration = data.getInput<InPortCalibration>();
 
-        return aruco_module_->TrackMarker(data.getTimestamp(), input_image, input_calibration, detector_, marker_size_);
+        if (pipeline_workers_ > 0) {
+            // copied into a recycled pipeline frame, input and luma buffer can be reused after returning
+            aruco_module_->SubmitFrame(data.getTimestamp(), input_image, input_calibration, marker_size_);
+            return true;
+        }
+
+        return aruco_module_->TrackMarker(data.getTimestamp(), input_image, input_calibration, *detector_, marker_size_);
     }
 
     // crucial in this module component as all outputs are independent sources from the dataflows point of view, so if no input is available then all outputs must send invalid
     bool processTimePointWithInvalid(buffer::ComponentBuffer &data) override {
+        if (pipeline_workers_ > 0) {
+            aruco_module_->SubmitNoValidInput(data.getTimestamp());
+            return true;
+        }
         aruco_module_->SendNoValidInput(data.getTimestamp());
         return true;
     }
 
  private:
-    std::unique_ptr<cv::aruco::ArucoDetector> detector_;
+    std::unique_ptr<SquareMarkerDetector> detector_;
+    DetectionPipeline::DetectorFactory detector_factory_;
+    int pipeline_workers_{0};
+    int max_frames_in_flight_{4};
+    DropPolicy drop_policy_{DropPolicy::BLOCK};
+    LumaExtractor luma_extractor_;
+    cv::Mat luma_buffer_;
     double marker_size_;
 
 };
@@ -0,0 +1,50 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "ArucoModule.h"
+#include <rttr/registration>
+
+namespace traact::component::aruco {
+
+/**
+ * All markers of a frame in one buffer, one request and commit per time point independent of the marker count
+ */
+class ArucoListOutput : public ArucoListOutputComponent {
+ public:
+    explicit ArucoListOutput(const std::string &name)
+        : ArucoListOutputComponent(name) {}
+
+    static traact::pattern::Pattern::Ptr GetPattern() {
+        traact::pattern::Pattern::Ptr
+            pattern =
+            std::make_shared<traact::pattern::Pattern>("ArucoListOutput", Concurrency::SERIAL, ComponentType::INTERNAL_SYNC_SOURCE);
+
+        pattern->addProducerPort("output", MarkerListHeader::NativeTypeName);
+        pattern->addParameter("min_id", 0)
+            .addParameter("max_id", -1)
+            .addParameter("camera_group", "global");
+
+        return pattern;
+    }
+
+    bool configure(const pattern::instance::PatternInstance &pattern_instance, buffer::ComponentBufferConfig *data) override {
+        aruco_module_ = std::dynamic_pointer_cast<ArucoModule>(module_);
+        pattern::setValueFromParameter(pattern_instance, "min_id", min_id_, 0);
+        pattern::setValueFromParameter(pattern_instance, "max_id", max_id_, -1);
+        if (max_id_ >= 0 && max_id_ < min_id_) {
+            SPDLOG_ERROR("ArucoListOutput {0} max_id {1} is smaller than min_id {2}", getName(), max_id_, min_id_);
+            return false;
+        }
+        aruco_module_->AddListOutput(this);
+        return true;
+    }
+
+};
+
+CREATE_TRAACT_COMPONENT_FACTORY(ArucoListOutput)
+
+}
+
+BEGIN_TRAACT_PLUGIN_REGISTRATION
+    REGISTER_DEFAULT_TRAACT_TYPE(traact::component::aruco::MarkerListHeader)
+    REGISTER_DEFAULT_COMPONENT(traact::component::aruco::ArucoListOutput)
+END_TRAACT_PLUGIN_REGISTRATION
@@ -1,14 +1,83 @@
 #include "ArucoModule.h"
 #include <opencv2/aruco.hpp>
+#include <opencv2/calib3d.hpp>
 #include <traact/opencv/OpenCVUtils.h>
 #include <opencv2/imgproc.hpp>
+#include <algorithm>
 
 namespace traact::component::aruco {
 
 void ArucoModule::AddOutput(int marker_id, ArucoOutputComponent *output_component) {
     SPDLOG_INFO("ArucoModule AddOutput marker_id {0}", marker_id);
-    output_components_.emplace(marker_id, output_component);
+    if (marker_id < 0) {
+        SPDLOG_ERROR("ArucoModule invalid marker_id {0}, output is ignored", marker_id);
+        return;
+    }
+    if (OutputIndex(marker_id) >= 0) {
+        SPDLOG_WARN("ArucoModule marker_id {0} already has an output, output is ignored", marker_id);
+        return;
+    }
+
+    if (static_cast<std::size_t>(marker_id) >= output_index_by_id_.size()) {
+        output_index_by_id_.resize(marker_id + 1, -1);
+    }
+    output_index_by_id_[marker_id] = static_cast<int>(output_components_.size());
+    output_components_.emplace_back(OutputSlot{marker_id, output_component});
+
+}
+
+void ArucoModule::AddBoardOutput(ArucoBoardOutputComponent *board_output_component) {
+    SPDLOG_INFO("ArucoModule AddBoardOutput {0} with {1} markers",
+                board_output_component->getName(),
+                board_output_component->Layout().markerIds().size());
+    board_output_components_.push_back(board_output_component);
+    for (auto marker_id : board_output_component->Layout().markerIds()) {
+        if (marker_id < 0) {
+            continue;
+        }
+        if (static_cast<std::size_t>(marker_id) >= board_marker_by_id_.size()) {
+            board_marker_by_id_.resize(marker_id + 1, 0);
+        }
+        board_marker_by_id_[marker_id] = 1;
+    }
+}
+
+void ArucoModule::AddListOutput(ArucoListOutputComponent *list_output_component) {
+    SPDLOG_INFO("ArucoModule AddListOutput {0}", list_output_component->getName());
+    list_output_components_.push_back(list_output_component);
+}
+
+void ArucoModule::SetDictionary(const cv::aruco::Dictionary &dictionary) {
+    dictionary_ = std::make_unique<cv::aruco::Dictionary>(dictionary);
+    // the per id tables cover every id of the dictionary before the first frame
+    pose_solver_.reserveMarkers(dictionary.bytesList.rows);
+    motion_filter_.reserveMarkers(dictionary.bytesList.rows);
+    frame_.marker_index_by_id.resize(std::max<std::size_t>(frame_.marker_index_by_id.size(),
+                                                           dictionary.bytesList.rows), -1);
+}
+
+bool ArucoModule::IsListed(int marker_id) const {
+    for (const auto *list_output : list_output_components_) {
+        if (list_output->Contains(marker_id)) {
+            return true;
+        }
+    }
+    return false;
+}
 
+bool ArucoModule::IsSubscribed(int marker_id) const {
+    if (OutputIndex(marker_id) >= 0 || IsListed(marker_id)) {
+        return true;
+    }
+    return marker_id >= 0 && static_cast<std::size_t>(marker_id) < board_marker_by_id_.size()
+        && board_marker_by_id_[marker_id];
+}
+
+int ArucoModule::OutputIndex(int marker_id) const {
+    if (marker_id < 0 || static_cast<std::size_t>(marker_id) >= output_index_by_id_.size()) {
+        return -1;
+    }
+    return output_index_by_id_[marker_id];
 }
 
 bool ArucoModule::init(Module::ComponentPtr module_component) {
@@ -18,11 +87,27 @@ bool ArucoModule::init(Module::ComponentPtr module_component) {
 
 bool ArucoModule::start(Module::ComponentPtr module_component) {
     SPDLOG_INFO("ArucoModule start from module_component");
+    summary_logged_ = false;
+    motion_filter_.reset();
+    if (dictionary_) {
+        for (auto *board_output : board_output_components_) {
+            if (!board_output->Layout().isBuilt()) {
+                board_output->BuildBoard(*dictionary_);
+            }
+        }
+    }
     return Module::start(module_component);
 }
 
 bool ArucoModule::stop(Module::ComponentPtr module_component) {
     SPDLOG_INFO("ArucoModule stop from module_component");
+    // the pipeline is stopped by ArucoInput, stop is also called for every output component of the module
+    // stop is called for every component of the module, only log once
+    if (!summary_logged_.exchange(true)) {
+        statistics_.logSummary(name_);
+        SPDLOG_INFO("{0} pose solves seeded from previous frame {1} fallbacks {2}",
+                    name_, pose_solver_.seededSolves(), pose_solver_.fallbackSolves());
+    }
     return Module::stop(module_component);
 }
 
@@ -31,8 +116,13 @@ bool ArucoModule::teardown(Module::ComponentPtr module_component) {
     return Module::teardown(module_component);
 }
 
+void ArucoComponent::configureInstance(const pattern::instance::PatternInstance &pattern_instance) {
+    pattern::setValueFromParameter(pattern_instance, "camera_group", camera_group_, "global");
+    connected_output_ports_ = pattern_instance.getOutputPortsConnected(kDefaultTimeDomain);
+}
+
 std::string ArucoComponent::getModuleKey() {
-    return "aruco_global";
+    return "aruco_" + camera_group_;
 }
 
 Module::Ptr ArucoComponent::instantiateModule() {
@@ -47,6 +137,14 @@ ArucoOutputComponent::ArucoOutputComponent(const std::string &name) : ArucoCompo
                                                                                      ComponentType::INTERNAL_SYNC_SOURCE,
                                                                                      ModuleType::GLOBAL) {}
 
+ArucoListOutputComponent::ArucoListOutputComponent(const std::string &name) : ArucoComponent(name,
+                                                                                             ComponentType::INTERNAL_SYNC_SOURCE,
+                                                                                             ModuleType::GLOBAL) {}
+
+ArucoBoardOutputComponent::ArucoBoardOutputComponent(const std::string &name) : ArucoComponent(name,
+                                                                                               ComponentType::INTERNAL_SYNC_SOURCE,
+                                                                                               ModuleType::GLOBAL) {}
+
 ArucoDebugOutputComponent::ArucoDebugOutputComponent(const std::string &name) : ArucoComponent(name,
                                                                                                ComponentType::INTERNAL_SYNC_SOURCE,
                                                                                                ModuleType::GLOBAL) {
@@ -54,59 +152,283 @@ ArucoDebugOutputComponent::ArucoDebugOutputComponent(const std::string &name) :
 }
 
 bool ArucoModule::TrackMarker(Timestamp ts, const cv::Mat &image, const traact::vision::CameraCalibration &calibration,
-                              std::unique_ptr<cv::aruco::ArucoDetector> &detector, double marker_size) {
+                              SquareMarkerDetector &detector, double marker_size) {
 
-    SPDLOG_INFO("ArucoModule TrackMarker");
+    SPDLOG_TRACE("ArucoModule TrackMarker");
 
-    std::vector<std::vector<cv::Point2f>> markers, rejected_candidates;
-    std::vector<int32_t> marker_ids;
-    detector->detectMarkers(
-        image,
-        markers,
-        marker_ids,
-        rejected_candidates);
+    DetectMarkers(image, detector, frame_);
+    EmitFrame(ts, image, calibration, marker_size, frame_);
 
-    if (debug_output_component_) {
-        cv::Mat debug_image;
-        cv::cvtColor(image, debug_image, cv::COLOR_GRAY2RGB);
-        cv::aruco::drawDetectedMarkers(debug_image, markers, marker_ids);
-        debug_output_component_->Send(debug_image, ts);
+    return true;
+}
+
+void ArucoModule::EmitFrame(Timestamp ts,
+                            const cv::Mat &image,
+                            const traact::vision::CameraCalibration &calibration,
+                            double marker_size,
+                            MarkerFrame &frame) {
+    EstimatePoses(image, calibration, marker_size, frame);
+    FilterPoses(ts, frame);
+    SendFrame(ts, image, frame);
+
+    if (statistics_.frameDone(statistics_interval_)) {
+        statistics_.logSummary(name_);
     }
+}
 
-    if (!marker_ids.empty()) {
-        cv::Mat cameraMatrix;
-        cv::Mat distortionCoefficientsMatrix;
-        traact2cv(calibration, cameraMatrix, distortionCoefficientsMatrix);
+void ArucoModule::StartPipeline(int workers,
+                                int max_frames_in_flight,
+                                DropPolicy drop_policy,
+                                const DetectionPipeline::DetectorFactory &detector_factory) {
+    StopPipeline();
+    SPDLOG_INFO("{0} start pipeline with {1} workers, {2} frames in flight", name_, workers, max_frames_in_flight);
+    std::lock_guard guard(pipeline_mutex_);
+    pipeline_ = std::make_unique<DetectionPipeline>(
+        workers, max_frames_in_flight, drop_policy, detector_factory,
+        [this](PipelineFrame &pipeline_frame, SquareMarkerDetector &detector) {
+            DetectMarkers(pipeline_frame.image, detector, pipeline_frame.frame);
+        },
+        [this](PipelineFrame &pipeline_frame) {
+            if (pipeline_frame.valid) {
+                EmitFrame(pipeline_frame.ts, pipeline_frame.image, pipeline_frame.calibration,
+                          pipeline_frame.marker_size, pipeline_frame.frame);
+            } else {
+                SendNoValidInput(pipeline_frame.ts);
+            }
+        });
+}
+
+void ArucoModule::StopPipeline() {
+    std::lock_guard guard(pipeline_mutex_);
+    if (pipeline_) {
+        pipeline_->stop();
+        pipeline_.reset();
+    }
+}
+
+void ArucoModule::SubmitFrame(Timestamp ts,
+                              const cv::Mat &image,
+                              const traact::vision::CameraCalibration &calibration,
+                              double marker_size) {
+    std::lock_guard guard(pipeline_mutex_);
+    if (!pipeline_) {
+        // not started or already stopped, the time point still needs a result
+        SendNoValidInput(ts);
+        return;
+    }
+    auto pipeline_frame = pipeline_->acquireFrame();
+    pipeline_frame->ts = ts;
+    pipeline_frame->valid = true;
+    // a recycled frame already has an image buffer of the right size
+    image.copyTo(pipeline_frame->image);
+    pipeline_frame->calibration = calibration;
+    pipeline_frame->marker_size = marker_size;
+    if (!pipeline_->submit(std::move(pipeline_frame))) {
+        SendNoValidInput(ts);
+    }
+}
 
-        std::vector<cv::Vec3d> r_vecs;
-        std::vector<cv::Vec3d> t_vecs;
+void ArucoModule::SubmitNoValidInput(Timestamp ts) {
+    std::lock_guard guard(pipeline_mutex_);
+    if (!pipeline_) {
+        SendNoValidInput(ts);
+        return;
+    }
+    auto pipeline_frame = pipeline_->acquireFrame();
+    pipeline_frame->ts = ts;
+    if (!pipeline_->submit(std::move(pipeline_frame))) {
+        SendNoValidInput(ts);
+    }
+}
 
-        cv::aruco::estimatePoseSingleMarkers(
-            markers, marker_size,
-            cameraMatrix,
-            distortionCoefficientsMatrix,
-            r_vecs,
-            t_vecs);
+void ArucoModule::DetectMarkers(const cv::Mat &image, SquareMarkerDetector &detector, MarkerFrame &frame) {
+    StageTimer timer(statistics_, ArucoStage::DETECTION);
+    auto draw_rejected = debug_output_component_ && debug_output_component_->DrawRejected();
+    detector.detect(image, frame.markers, frame.marker_ids, [this](int marker_id) {
+        return IsSubscribed(marker_id);
+    }, draw_rejected ? &frame.rejected_markers : nullptr);
+    if (!draw_rejected) {
+        frame.rejected_markers.clear();
+    }
 
-        for (auto &output : output_components_) {
-            auto has_marker = std::find(marker_ids.begin(), marker_ids.end(), output.first);
-            if (has_marker == marker_ids.end()) {
-                output.second->SendInvalid(ts);
+    // only solve the pose of markers someone listens to, first detection wins for duplicated ids
+    std::size_t subscribed_count{0};
+    frame.subscribed_marker_ids.clear();
+    frame.marker_index_by_output.assign(output_components_.size(), -1);
+    std::size_t unsubscribed_count{0};
+    for (std::size_t i = 0; i < frame.marker_ids.size(); ++i) {
+        auto marker_id = frame.marker_ids[i];
+        auto output_index = OutputIndex(marker_id);
+        if (output_index < 0 && !IsListed(marker_id)) {
+            if (!IsSubscribed(marker_id)) {
+                ++unsubscribed_count;
+            }
+            continue;
+        }
+        if (static_cast<std::size_t>(marker_id) >= frame.marker_index_by_id.size()) {
+            frame.marker_index_by_id.resize(marker_id + 1, -1);
+        }
+        if (frame.marker_index_by_id[marker_id] >= 0) {
+            continue;
+        }
+        frame.marker_index_by_id[marker_id] = static_cast<int>(subscribed_count);
+        if (output_index >= 0) {
+            frame.marker_index_by_output[output_index] = static_cast<int>(subscribed_count);
+        }
+        assignMarker(frame.subscribed_markers, subscribed_count++, frame.markers[i]);
+        frame.subscribed_marker_ids.push_back(marker_id);
+    }
+    frame.subscribed_markers.resize(subscribed_count);
+    // only reset the touched entries, a full reset would cost the size of the dictionary every frame
+    for (auto marker_id : frame.subscribed_marker_ids) {
+        frame.marker_index_by_id[marker_id] = -1;
+    }
+    statistics_.countMarkers(frame.marker_ids.size(), unsubscribed_count);
+}
+
+void ArucoModule::EstimatePoses(const cv::Mat &image,
+                                const traact::vision::CameraCalibration &calibration,
+                                double marker_size,
+                                MarkerFrame &frame) {
+    StageTimer timer(statistics_, ArucoStage::POSE_ESTIMATION);
+    frame.r_vecs.clear();
+    frame.t_vecs.clear();
+    frame.confidences.clear();
+    frame.solved.clear();
+    frame.reprojection_errors.clear();
+    pose_solver_.nextFrame();
+    frame.board_poses.resize(board_output_components_.size());
+    for (auto &board_pose : frame.board_poses) {
+        board_pose.valid = false;
+    }
+
+    auto has_board_markers = !board_output_components_.empty() && !frame.marker_ids.empty();
+    if (frame.subscribed_markers.empty() && !has_board_markers) {
+        return;
+    }
+
+    pose_solver_.setCalibration(calibration, image.size());
+    pose_solver_.setMarkerSize(marker_size);
+    const auto &cameraMatrix = pose_solver_.cameraMatrix();
+    const auto &distortionCoefficientsMatrix = pose_solver_.distortionCoefficients();
+
+    if (!frame.subscribed_markers.empty()) {
+        pose_solver_.solveMarkers(frame.subscribed_markers,
+                                  frame.subscribed_marker_ids,
+                                  frame.r_vecs,
+                                  frame.t_vecs,
+                                  frame.reprojection_errors,
+                                  frame.solved);
+        frame.confidences.assign(frame.r_vecs.size(), 1.0);
+        for (std::size_t i = 0; i < frame.solved.size(); ++i) {
+            if (frame.solved[i]) {
+                statistics_.recordReprojectionError(frame.reprojection_errors[i]);
             } else {
-                int marker_index = has_marker - marker_ids.begin();
-                spatial::Pose6DHeader::NativeType result;
-                cv2traact(r_vecs[marker_index], t_vecs[marker_index], result);
-                output.second->SendMarker(result, ts);
+                frame.confidences[i] = 0.0;
             }
+        }
+        // outputs of markers without a pose send invalid, or are bridged by the motion filter
+        for (auto &marker_index : frame.marker_index_by_output) {
+            if (marker_index >= 0 && !frame.solved[marker_index]) {
+                marker_index = -1;
+            }
+        }
+    }
 
+    if (has_board_markers) {
+        for (std::size_t i = 0; i < board_output_components_.size(); ++i) {
+            board_output_components_[i]->EstimatePose(image, frame, cameraMatrix, distortionCoefficientsMatrix,
+                                                      frame.board_poses[i]);
         }
-    } else {
-        for (auto &output : output_components_) {
-            output.second->SendInvalid(ts);
+    }
+}
+
+void ArucoModule::FilterPoses(Timestamp ts, MarkerFrame &frame) {
+    if (!motion_filter_.enabled()) {
+        return;
+    }
+    StageTimer timer(statistics_, ArucoStage::POSE_ESTIMATION);
+    for (std::size_t i = 0; i < frame.subscribed_marker_ids.size(); ++i) {
+        auto marker_id = frame.subscribed_marker_ids[i];
+        if (!frame.solved[i]) {
+            continue;
         }
+        motion_filter_.update(marker_id, ts, frame.r_vecs[i], frame.t_vecs[i]);
+        // the pose is smoothed and shifted by the prediction horizon, but it is still measured in this frame
+        double prediction_confidence;
+        motion_filter_.predict(marker_id, ts, frame.r_vecs[i], frame.t_vecs[i], prediction_confidence);
     }
 
-    return true;
+    // undetected markers of board and list outputs stay invalid, only marker outputs are bridged
+    for (std::size_t output_index = 0; output_index < output_components_.size(); ++output_index) {
+        auto marker_id = output_components_[output_index].marker_id;
+        if (frame.marker_index_by_output[output_index] >= 0 || !motion_filter_.canBridge(marker_id, ts)) {
+            continue;
+        }
+        frame.marker_index_by_output[output_index] = static_cast<int>(frame.r_vecs.size());
+        frame.r_vecs.emplace_back();
+        frame.t_vecs.emplace_back();
+        frame.confidences.emplace_back();
+        motion_filter_.predict(marker_id, ts, frame.r_vecs.back(), frame.t_vecs.back(), frame.confidences.back());
+    }
+}
+
+void ArucoModule::SendFrame(Timestamp ts, const cv::Mat &image, const MarkerFrame &frame) {
+    auto &dispatcher = dispatcher_;
+    StageTimer timer(statistics_, ArucoStage::OUTPUT_DISPATCH);
+
+    if (debug_output_component_) {
+        if (debug_output_component_->ShouldRender()) {
+            debug_output_component_->Send(dispatcher, image, frame, timer, ts);
+        } else {
+            debug_output_component_->SendInvalid(dispatcher, ts);
+        }
+    }
+
+    for (std::size_t output_index = 0; output_index < output_components_.size(); ++output_index) {
+        auto *output = output_components_[output_index].component;
+        auto marker_index = frame.marker_index_by_output[output_index];
+        if (marker_index < 0) {
+            output->SendInvalid(dispatcher, ts);
+        } else {
+            output->SendMarker(dispatcher, frame, marker_index, ts);
+        }
+    }
+
+    for (auto *list_output : list_output_components_) {
+        list_output->SendMarkers(dispatcher, frame, ts);
+    }
+
+    for (std::size_t board_index = 0; board_index < board_output_components_.size(); ++board_index) {
+        const auto &board_pose = frame.board_poses[board_index];
+        if (board_pose.valid) {
+            board_output_components_[board_index]->SendPose(dispatcher, board_pose, ts);
+        } else {
+            board_output_components_[board_index]->SendInvalid(dispatcher, ts);
+        }
+    }
+
+    dispatcher.dispatch();
+}
+
+void ArucoModule::SetName(const std::string &name) {
+    name_ = name;
+}
+
+void ArucoModule::SetStatisticsInterval(int frames) {
+    statistics_interval_ = frames;
+}
+
+void ArucoModule::SetTemporalRefine(bool temporal_refine) {
+    pose_solver_.setTemporalRefine(temporal_refine);
+}
+
+void ArucoModule::SetMotionFilter(const MotionFilterConfig &config) {
+    motion_filter_.configure(config);
+}
+
+const ArucoStatistics &ArucoModule::Statistics() const {
+    return statistics_;
 }
 
 void ArucoModule::SetDebugOutput(ArucoDebugOutputComponent *debug_output_component) {
@@ -115,51 +437,217 @@ void ArucoModule::SetDebugOutput(ArucoDebugOutputComponent *debug_output_compone
 }
 
 void ArucoModule::SendNoValidInput(Timestamp ts) {
+    auto &dispatcher = dispatcher_;
     for (auto &output : output_components_) {
-        output.second->SendInvalid(ts);
+        output.component->SendInvalid(dispatcher, ts);
     }
+    if (debug_output_component_) {
+        debug_output_component_->SendInvalid(dispatcher, ts);
+    }
+    for (auto *list_output : list_output_components_) {
+        list_output->SendInvalid(dispatcher, ts);
+    }
+    for (auto *board_output : board_output_components_) {
+        board_output->SendInvalid(dispatcher, ts);
+    }
+    dispatcher.dispatch();
 
 }
 
-void ArucoOutputComponent::SendMarker(spatial::Pose6DHeader::NativeType pose, Timestamp ts) {
-    SPDLOG_INFO("ArucoOutputComponent Send {0} {1}", getName(), ts.time_since_epoch().count());
-    auto buffer_future = request_callback_(ts);
-    buffer_future.wait();
-    auto buffer = buffer_future.get();
-    if (buffer == nullptr) {
-        SPDLOG_ERROR("Could not get source buffer for ts {0}", ts.time_since_epoch().count());
-        return;
-    }
-    auto &output = buffer->getOutput<spatial::Pose6DHeader::NativeType, spatial::Pose6DHeader>(0);
-    output = pose;
-    buffer->commit(true);
+OutputDispatcher::BufferFuture ArucoComponent::RequestBuffer(Timestamp ts) {
+    return request_callback_(ts);
+}
 
+bool ArucoComponent::IsOutputConnected(std::size_t port_index) const {
+    return port_index < connected_output_ports_.size() && connected_output_ports_[port_index];
 }
 
-void ArucoOutputComponent::SendInvalid(Timestamp ts) {
-    SPDLOG_INFO("ArucoOutputComponent Invalid {0} {1}", getName(), ts.time_since_epoch().count());
-    auto buffer_future = request_callback_(ts);
-    buffer_future.wait();
-    auto buffer = buffer_future.get();
-    if (buffer == nullptr) {
-        SPDLOG_ERROR("Could not get source buffer for ts {0}", ts.time_since_epoch().count());
-        return;
+void ArucoOutputComponent::SendMarker(OutputDispatcher &dispatcher,
+                                      const MarkerFrame &frame,
+                                      int marker_index,
+                                      Timestamp ts) {
+    SPDLOG_TRACE("ArucoOutputComponent Send {0} {1}", getName(), ts.time_since_epoch().count());
+    // a reference, an index and a flag fit the small buffer of std::function, a captured pose would be heap allocated
+    const bool send_confidence = IsOutputConnected(1);
+    dispatcher.add(RequestBuffer(ts), ts, [&frame, marker_index, send_confidence](buffer::SourceComponentBuffer &buffer) {
+        auto &output = buffer.getOutput<spatial::Pose6DHeader::NativeType, spatial::Pose6DHeader>(0);
+        cv2traact(frame.r_vecs[marker_index], frame.t_vecs[marker_index], output);
+        if (send_confidence) {
+            buffer.getOutput<MarkerConfidenceHeader::NativeType, MarkerConfidenceHeader>(1) =
+                frame.confidences[marker_index];
+        }
+        return true;
+    });
+}
+
+void ArucoOutputComponent::SendInvalid(OutputDispatcher &dispatcher, Timestamp ts) {
+    SPDLOG_TRACE("ArucoOutputComponent Invalid {0} {1}", getName(), ts.time_since_epoch().count());
+    dispatcher.add(RequestBuffer(ts), ts, [](buffer::SourceComponentBuffer &) {
+        return false;
+    });
+}
+
+void ArucoDebugOutputComponent::Send(OutputDispatcher &dispatcher,
+                                     const cv::Mat &image,
+                                     const MarkerFrame &frame,
+                                     StageTimer &dispatch_timer,
+                                     Timestamp ts) {
+    SPDLOG_TRACE("ArucoDebugOutputComponent Send {0} {1}", getName(), ts.time_since_epoch().count());
+    render_context_ = RenderContext{&image, &frame, &dispatch_timer};
+    // one pointer fits the small buffer of std::function, the three references would be heap allocated
+    dispatcher.add(RequestBuffer(ts), ts, [context = &render_context_](buffer::SourceComponentBuffer &buffer) {
+        using namespace traact::vision;
+        const auto &image = *context->image;
+        const auto &frame = *context->frame;
+        StageTimer timer(*context->dispatch_timer, ArucoStage::DEBUG_RENDERING);
+        auto &header = buffer.getOutputHeader<ImageHeader>(0);
+        header.width = image.cols;
+        header.height = image.rows;
+        header.pixel_format = PixelFormat::RGB;
+        header.base_type = BaseType::UINT_8;
+        header.channels = 3;
+        header.stride = header.width;
+
+        // the buffer keeps its allocation between time points, cvtColor only reallocates if the size changed
+        auto &debug_image = buffer.getOutput<ImageHeader>(0).value();
+        cv::cvtColor(image, debug_image, cv::COLOR_GRAY2RGB);
+        if (!frame.rejected_markers.empty()) {
+            cv::aruco::drawDetectedMarkers(debug_image, frame.rejected_markers, cv::noArray(), cv::Scalar(255, 0, 0));
+        }
+        cv::aruco::drawDetectedMarkers(debug_image, frame.markers, frame.marker_ids);
+        return true;
+    });
+}
+
+bool ArucoDebugOutputComponent::ShouldRender() {
+    if (debug_rate_ <= 0) {
+        return false;
     }
-    buffer->commit(false);
+    return frame_count_.fetch_add(1, std::memory_order_relaxed) % debug_rate_ == 0;
+}
+
+bool ArucoDebugOutputComponent::DrawRejected() const {
+    return draw_rejected_;
+}
+
+void ArucoDebugOutputComponent::SendInvalid(OutputDispatcher &dispatcher, Timestamp ts) {
+    dispatcher.add(RequestBuffer(ts), ts, [](buffer::SourceComponentBuffer &) {
+        return false;
+    });
+}
+
+void ArucoListOutputComponent::SetIdRange(int min_id, int max_id) {
+    min_id_ = min_id;
+    max_id_ = max_id;
+}
+
+bool ArucoListOutputComponent::Contains(int marker_id) const {
+    return marker_id >= min_id_ && (max_id_ < 0 || marker_id <= max_id_);
 }
 
-void ArucoDebugOutputComponent::Send(cv::Mat debug_image, Timestamp ts) {
-    SPDLOG_INFO("ArucoDebugOutputComponent Send {0} {1}", getName(), ts.time_since_epoch().count());
-    auto buffer_future = request_callback_(ts);
-    buffer_future.wait();
-    auto buffer = buffer_future.get();
-    if (buffer == nullptr) {
-        SPDLOG_ERROR("Could not get source buffer for ts {0}", ts.time_since_epoch().count());
+void ArucoListOutputComponent::SendMarkers(OutputDispatcher &dispatcher, const MarkerFrame &frame, Timestamp ts) {
+    SPDLOG_TRACE("ArucoListOutputComponent Send {0} {1}", getName(), ts.time_since_epoch().count());
+    dispatcher.add(RequestBuffer(ts), ts, [this, &frame](buffer::SourceComponentBuffer &buffer) {
+        auto &marker_list = buffer.getOutput<MarkerListHeader::NativeType, MarkerListHeader>(0);
+        marker_list.clear();
+        for (std::size_t i = 0; i < frame.subscribed_marker_ids.size(); ++i) {
+            auto marker_id = frame.subscribed_marker_ids[i];
+            if (!Contains(marker_id) || !frame.solved[i]) {
+                continue;
+            }
+            const auto &corners = frame.subscribed_markers[i];
+            marker_list.ids.push_back(marker_id);
+            marker_list.corners.insert(marker_list.corners.end(), corners.begin(), corners.end());
+            marker_list.poses.emplace_back();
+            cv2traact(frame.r_vecs[i], frame.t_vecs[i], marker_list.poses.back());
+            marker_list.reprojection_errors.push_back(static_cast<float>(frame.reprojection_errors[i]));
+            marker_list.confidences.push_back(static_cast<float>(frame.confidences[i]));
+        }
+        return true;
+    });
+}
+
+void ArucoListOutputComponent::SendInvalid(OutputDispatcher &dispatcher, Timestamp ts) {
+    SPDLOG_TRACE("ArucoListOutputComponent Invalid {0} {1}", getName(), ts.time_since_epoch().count());
+    dispatcher.add(RequestBuffer(ts), ts, [](buffer::SourceComponentBuffer &) {
+        return false;
+    });
+}
+
+const BoardLayout &ArucoBoardOutputComponent::Layout() const {
+    return layout_;
+}
+
+void ArucoBoardOutputComponent::BuildBoard(const cv::aruco::Dictionary &dictionary) {
+    layout_.build(dictionary);
+}
+
+void ArucoBoardOutputComponent::EstimatePose(const cv::Mat &image,
+                                             const MarkerFrame &frame,
+                                             const cv::Mat &camera_matrix,
+                                             const cv::Mat &distortion_coefficients,
+                                             BoardPose &result) {
+    result.valid = false;
+    result.inliers.clear();
+
+    object_points_.clear();
+    image_points_.clear();
+    layout_.matchImagePoints(image, frame.markers, frame.marker_ids, object_points_, image_points_);
+    if (object_points_.size() < 4) {
         return;
     }
-    auto &output = buffer->getOutput<vision::ImageHeader>(0);
-    output.update(debug_image);
-    buffer->commit(true);
+
+    cv::Vec3d r_vec;
+    cv::Vec3d t_vec;
+    // ransac needs more than the minimal sample, a single visible marker is solved directly
+    if (object_points_.size() < 6) {
+        if (!cv::solvePnP(object_points_, image_points_, camera_matrix, distortion_coefficients, r_vec, t_vec)) {
+            return;
+        }
+        result.inliers = image_points_;
+    } else {
+        inlier_indices_.clear();
+        if (!cv::solvePnPRansac(object_points_, image_points_, camera_matrix, distortion_coefficients, r_vec, t_vec,
+                                false, 100, static_cast<float>(reprojection_error_), 0.99, inlier_indices_)
+            || inlier_indices_.size() < 4) {
+            return;
+        }
+        inlier_object_points_.clear();
+        for (auto index : inlier_indices_) {
+            inlier_object_points_.push_back(object_points_[index]);
+            result.inliers.push_back(image_points_[index]);
+        }
+        cv::solvePnPRefineLM(inlier_object_points_, result.inliers, camera_matrix, distortion_coefficients, r_vec,
+                             t_vec);
+    }
+
+    result.r_vec = r_vec;
+    result.t_vec = t_vec;
+    result.valid = true;
 }
 
-}
\ No newline at end of file
+void ArucoBoardOutputComponent::SendPose(OutputDispatcher &dispatcher, const BoardPose &board_pose, Timestamp ts) {
+    SPDLOG_TRACE("ArucoBoardOutputComponent Send {0} {1}", getName(), ts.time_since_epoch().count());
+    const bool send_inliers = IsOutputConnected(1);
+    dispatcher.add(RequestBuffer(ts), ts, [&board_pose, send_inliers](buffer::SourceComponentBuffer &buffer) {
+        auto &pose = buffer.getOutput<spatial::Pose6DHeader::NativeType, spatial::Pose6DHeader>(0);
+        cv2traact(board_pose.r_vec, board_pose.t_vec, pose);
+        if (send_inliers) {
+            auto &inliers = buffer.getOutput<vision::Position2DListHeader::NativeType, vision::Position2DListHeader>(1);
+            inliers.clear();
+            for (const auto &point : board_pose.inliers) {
+                inliers.emplace_back(point.x, point.y);
+            }
+        }
+        return true;
+    });
+}
+
+void ArucoBoardOutputComponent::SendInvalid(OutputDispatcher &dispatcher, Timestamp ts) {
+    SPDLOG_TRACE("ArucoBoardOutputComponent Invalid {0} {1}", getName(), ts.time_since_epoch().count());
+    dispatcher.add(RequestBuffer(ts), ts, [](buffer::SourceComponentBuffer &) {
+        return false;
+    });
+}
+
+}
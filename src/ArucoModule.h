@@ -5,11 +5,25 @@
 #include <traact/vision.h>
 #include <traact/spatial.h>
 #include <opencv2/aruco.hpp>
+#include <atomic>
+#include <mutex>
+#include "SquareMarkerDetector.h"
+#include "OutputDispatcher.h"
+#include "ArucoStatistics.h"
+#include "BoardLayout.h"
+#include "PoseSolver.h"
+#include "MarkerFrame.h"
+#include "MarkerList.h"
+#include "MarkerConfidence.h"
+#include "MotionFilter.h"
+#include "DetectionPipeline.h"
 
 namespace traact::component::aruco {
 
 class ArucoOutputComponent;
 class ArucoDebugOutputComponent;
+class ArucoBoardOutputComponent;
+class ArucoListOutputComponent;
 
 class ArucoModule : public Module {
  public:
@@ -24,15 +38,131 @@ class ArucoModule : public Module {
 
     void AddOutput(int marker_id, ArucoOutputComponent *output_component);
     void SetDebugOutput(ArucoDebugOutputComponent *debug_output_component);
+    void AddBoardOutput(ArucoBoardOutputComponent *board_output_component);
+    /**
+     * the poses of all markers in the id range of the list output are estimated, with or without an ArucoOutput
+     */
+    void AddListOutput(ArucoListOutputComponent *list_output_component);
+
+    /**
+     * dictionary of the input, needed to create the boards of board outputs. Also sizes the per id tables of
+     * pose seeds and motion filter.
+     */
+    void SetDictionary(const cv::aruco::Dictionary &dictionary);
+
+    /**
+     * name used in log messages, usually containing the camera group
+     */
+    void SetName(const std::string &name);
+
+    /**
+     * Log a summary of the stage latencies every frames time points, 0 only logs when the module stops
+     */
+    void SetStatisticsInterval(int frames);
+    const ArucoStatistics &Statistics() const;
+
+    /**
+     * seed the marker poses from the previous frame, see PoseSolver
+     */
+    void SetTemporalRefine(bool temporal_refine);
+
+    /**
+     * Kalman filter of the marker poses, outputs send the pose extrapolated to the prediction horizon and bridge
+     * short dropouts of ArucoOutput markers with the prediction
+     */
+    void SetMotionFilter(const MotionFilterConfig &config);
 
     bool TrackMarker(Timestamp ts, const cv::Mat &image, const traact::vision::CameraCalibration &calibration,
-                     std::unique_ptr<cv::aruco::ArucoDetector> &detector,double marker_size);
+                     SquareMarkerDetector &detector, double marker_size);
+
+    /**
+     * Stages of TrackMarker, usable on their own without a running dataflow
+     */
+    void DetectMarkers(const cv::Mat &image, SquareMarkerDetector &detector, MarkerFrame &frame);
+    void EstimatePoses(const cv::Mat &image,
+                       const traact::vision::CameraCalibration &calibration,
+                       double marker_size,
+                       MarkerFrame &frame);
+    /**
+     * Replace the measured poses by the motion filter prediction and append predicted poses of undetected markers
+     * with an ArucoOutput, does nothing without a motion filter. Poses have to be filtered in timestamp order.
+     */
+    void FilterPoses(Timestamp ts, MarkerFrame &frame);
+    /**
+     * Not thread safe, frames are sent one after another by processTimePoint or the pipeline emitter
+     */
+    void SendFrame(Timestamp ts, const cv::Mat &image, const MarkerFrame &frame);
 
     void SendNoValidInput(Timestamp ts);
 
+    /**
+     * Pipelined TrackMarker: frames are detected concurrently by the workers of a DetectionPipeline, poses are
+     * estimated and sent on its emitter thread in timestamp order, so the temporal pose refine stays valid.
+     */
+    void StartPipeline(int workers,
+                       int max_frames_in_flight,
+                       DropPolicy drop_policy,
+                       const DetectionPipeline::DetectorFactory &detector_factory);
+    void StopPipeline();
+    /**
+     * Without a running pipeline the time point is sent as invalid.
+     *
+     * @param image copied into a recycled frame of the pipeline, can be reused by the caller on return
+     */
+    void SubmitFrame(Timestamp ts, const cv::Mat &image, const traact::vision::CameraCalibration &calibration,
+                     double marker_size);
+    void SubmitNoValidInput(Timestamp ts);
+
  private:
-    std::map<int, ArucoOutputComponent *> output_components_;
+    struct OutputSlot {
+        int marker_id;
+        ArucoOutputComponent *component;
+    };
+
+    /**
+     * index into output_components_ for a dictionary id, -1 if no output is subscribed to the id
+     */
+    int OutputIndex(int marker_id) const;
+    /**
+     * pose estimation, output dispatch and statistics of a detected frame
+     */
+    void EmitFrame(Timestamp ts,
+                   const cv::Mat &image,
+                   const traact::vision::CameraCalibration &calibration,
+                   double marker_size,
+                   MarkerFrame &frame);
+    /**
+     * true if the marker is in the id range of a list output
+     */
+    bool IsListed(int marker_id) const;
+    /**
+     * true if a marker, list or board output needs the marker
+     */
+    bool IsSubscribed(int marker_id) const;
+
+    std::vector<OutputSlot> output_components_;
+    std::vector<int> output_index_by_id_;
     ArucoDebugOutputComponent *debug_output_component_{nullptr};
+    std::vector<ArucoBoardOutputComponent *> board_output_components_;
+    std::vector<char> board_marker_by_id_;
+    std::vector<ArucoListOutputComponent *> list_output_components_;
+    std::unique_ptr<cv::aruco::Dictionary> dictionary_;
+    PoseSolver pose_solver_;
+    MotionFilter motion_filter_;
+    /**
+     * held while submitting and while starting or stopping the pipeline, so a stop never races a submit
+     */
+    std::mutex pipeline_mutex_;
+    std::unique_ptr<DetectionPipeline> pipeline_;
+
+    // reused for every time point of TrackMarker, so the steady state does not allocate
+    MarkerFrame frame_;
+    OutputDispatcher dispatcher_;
+
+    std::string name_{"ArucoModule"};
+    ArucoStatistics statistics_;
+    int statistics_interval_{0};
+    std::atomic<bool> summary_logged_{false};
 
 };
 
@@ -43,11 +173,26 @@ class ArucoComponent : public ModuleComponent {
 
 
 
+    /**
+     * Reads the camera_group parameter, components of the same group share one ArucoModule.
+     * Also caches which output ports are connected, optional ports are only written if they are.
+     */
+    void configureInstance(const pattern::instance::PatternInstance &pattern_instance) override;
+
     std::string getModuleKey() override;
     Module::Ptr instantiateModule() override;
 
+    OutputDispatcher::BufferFuture RequestBuffer(Timestamp ts);
+
+    /**
+     * false for ports that are not connected, or if configureInstance was not called
+     */
+    bool IsOutputConnected(std::size_t port_index) const;
+
  protected:
     std::shared_ptr<ArucoModule> aruco_module_;
+    std::string camera_group_{"global"};
+    pattern::instance::LocalConnectedOutputPorts connected_output_ports_;
 
 
 };
@@ -56,9 +201,13 @@ class ArucoOutputComponent : public ArucoComponent {
  public:
     explicit ArucoOutputComponent(const std::string &name);
 
-    void SendMarker(spatial::Pose6DHeader::NativeType pose, Timestamp ts);
+    /**
+     * Pose and, if its port is connected, confidence of entry marker_index of the frame.
+     * frame must stay valid until the dispatcher finished.
+     */
+    void SendMarker(OutputDispatcher &dispatcher, const MarkerFrame &frame, int marker_index, Timestamp ts);
 
-    void SendInvalid(Timestamp ts);
+    void SendInvalid(OutputDispatcher &dispatcher, Timestamp ts);
 
 
 };
@@ -67,8 +216,114 @@ class ArucoDebugOutputComponent : public ArucoComponent {
  public:
     explicit ArucoDebugOutputComponent(const std::string &name);
 
-    void Send(cv::Mat debug_image, Timestamp ts);
+    /**
+     * Render the detected markers directly into the output buffer once it is available.
+     * image, frame and dispatch_timer must stay valid until the dispatcher finished, the rendering is recorded
+     * as its own stage and excluded from the dispatch timer. One frame can be in the dispatcher at a time.
+     */
+    void Send(OutputDispatcher &dispatcher,
+              const cv::Mat &image,
+              const MarkerFrame &frame,
+              StageTimer &dispatch_timer,
+              Timestamp ts);
+
+    void SendInvalid(OutputDispatcher &dispatcher, Timestamp ts);
+
+    /**
+     * @return true every debug_rate frames, false otherwise or if debug_rate is 0
+     */
+    bool ShouldRender();
+
+    /**
+     * true if the rejected candidates are drawn, they are only collected by the detector then
+     */
+    bool DrawRejected() const;
+
+ protected:
+    int debug_rate_{1};
+    bool draw_rejected_{false};
+    std::atomic<std::uint64_t> frame_count_{0};
+
+ private:
+    /**
+     * arguments of the pending Send, the fill function only captures a pointer to it
+     */
+    struct RenderContext {
+        const cv::Mat *image{nullptr};
+        const MarkerFrame *frame{nullptr};
+        StageTimer *dispatch_timer{nullptr};
+    };
+    RenderContext render_context_;
+
+};
+
+class ArucoListOutputComponent : public ArucoComponent {
+ public:
+    explicit ArucoListOutputComponent(const std::string &name);
+
+    /**
+     * @param max_id -1 for no upper bound
+     */
+    void SetIdRange(int min_id, int max_id);
+
+    /**
+     * true if marker_id is in the id range of the output
+     */
+    bool Contains(int marker_id) const;
 
+    /**
+     * All pose estimated markers of the frame in the id range, in one buffer.
+     * The list is valid and empty if no marker was detected. frame must stay valid until the dispatcher finished.
+     */
+    void SendMarkers(OutputDispatcher &dispatcher, const MarkerFrame &frame, Timestamp ts);
+
+    void SendInvalid(OutputDispatcher &dispatcher, Timestamp ts);
+
+ protected:
+    int min_id_{0};
+    /**
+     * -1 for no upper bound
+     */
+    int max_id_{-1};
+
+};
+
+class ArucoBoardOutputComponent : public ArucoComponent {
+ public:
+    explicit ArucoBoardOutputComponent(const std::string &name);
+
+    const BoardLayout &Layout() const;
+    void BuildBoard(const cv::aruco::Dictionary &dictionary);
+
+    /**
+     * Single PnP over all visible corners of the board, the point buffers are reused between frames
+     */
+    void EstimatePose(const cv::Mat &image,
+                      const MarkerFrame &frame,
+                      const cv::Mat &camera_matrix,
+                      const cv::Mat &distortion_coefficients,
+                      BoardPose &result);
+
+    /**
+     * Pose and, if its port is connected, the inlier image points. board_pose must stay valid until the dispatcher
+     * finished.
+     */
+    void SendPose(OutputDispatcher &dispatcher, const BoardPose &board_pose, Timestamp ts);
+
+    void SendInvalid(OutputDispatcher &dispatcher, Timestamp ts);
+
+ protected:
+    BoardLayout layout_;
+    /**
+     * maximal reprojection error in pixel of inliers
+     */
+    double reprojection_error_{3.0};
+
+ private:
+    std::vector<cv::Point3f> object_points_;
+    std::vector<cv::Point2f> image_points_;
+    std::vector<int> inlier_indices_;
+    std::vector<cv::Point3f> inlier_object_points_;
 
 };
 
@@ -15,7 +15,9 @@ class ArucoOutput : public ArucoOutputComponent {
             std::make_shared<traact::pattern::Pattern>("ArucoOutput", Concurrency::SERIAL, ComponentType::INTERNAL_SYNC_SOURCE);
 
         pattern->addProducerPort("output", spatial::Pose6DHeader::NativeTypeName);
+        pattern->addProducerPort("output_confidence", MarkerConfidenceHeader::NativeTypeName);
         pattern->addParameter("marker_id", 0);
+        pattern->addParameter("camera_group", "global");
 
         return pattern;
     }
@@ -39,5 +41,6 @@ CREATE_TRAACT_COMPONENT_FACTORY(ArucoOutput)
 }
 
 BEGIN_TRAACT_PLUGIN_REGISTRATION
+    REGISTER_DEFAULT_TRAACT_TYPE(traact::component::aruco::MarkerConfidenceHeader)
     REGISTER_DEFAULT_COMPONENT(traact::component::aruco::ArucoOutput)
 END_TRAACT_PLUGIN_REGISTRATION
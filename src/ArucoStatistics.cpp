@@ -0,0 +1,156 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "ArucoStatistics.h"
+#include <traact/traact.h>
+#include <algorithm>
+#include <cmath>
+
+namespace traact::component::aruco {
+
+const char *toString(ArucoStage stage) {
+    switch (stage) {
+        case ArucoStage::DETECTION:return "detection";
+        case ArucoStage::POSE_ESTIMATION:return "pose_estimation";
+        case ArucoStage::OUTPUT_DISPATCH:return "output_dispatch";
+        case ArucoStage::DEBUG_RENDERING:return "debug_rendering";
+        default:return "unknown";
+    }
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds duration) {
+    auto nanoseconds = static_cast<std::uint64_t>(std::max<std::int64_t>(0, duration.count()));
+    buckets_[bucketIndex(nanoseconds / 1000)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+    auto current_max = max_ns_.load(std::memory_order_relaxed);
+    while (nanoseconds > current_max
+        && !max_ns_.compare_exchange_weak(current_max, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Summary LatencyHistogram::summarize() const {
+    Summary summary;
+    summary.count = count_.load(std::memory_order_relaxed);
+    if (summary.count == 0) {
+        return summary;
+    }
+    summary.mean_ms = total_ns_.load(std::memory_order_relaxed) / 1e6 / summary.count;
+    summary.max_ms = max_ns_.load(std::memory_order_relaxed) / 1e6;
+
+    auto percentile = [this, &summary](double fraction) {
+        auto target = static_cast<std::uint64_t>(fraction * summary.count);
+        std::uint64_t seen{0};
+        for (std::size_t i = 0; i < kBucketCount; ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen > target) {
+                return std::min(bucketUpperBoundMs(i), summary.max_ms);
+            }
+        }
+        return summary.max_ms;
+    };
+    summary.p50_ms = percentile(0.5);
+    summary.p90_ms = percentile(0.9);
+    summary.p99_ms = percentile(0.99);
+    return summary;
+}
+
+std::size_t LatencyHistogram::bucketIndex(std::uint64_t microseconds) {
+    if (microseconds < 4) {
+        return microseconds;
+    }
+    std::size_t msb{2};
+    while (microseconds >> (msb + 1)) {
+        ++msb;
+    }
+    auto sub_bucket = (microseconds >> (msb - 2)) & 3;
+    return std::min<std::size_t>(4 * (msb - 1) + sub_bucket, kBucketCount - 1);
+}
+
+double LatencyHistogram::bucketUpperBoundMs(std::size_t index) {
+    if (index < 4) {
+        return (index + 1) / 1000.0;
+    }
+    auto msb = index / 4 + 1;
+    auto sub_bucket = index % 4;
+    return static_cast<double>((5 + sub_bucket) << (msb - 2)) / 1000.0;
+}
+
+void ArucoStatistics::record(ArucoStage stage, std::chrono::nanoseconds duration) {
+    histograms_[static_cast<std::size_t>(stage)].record(duration);
+}
+
+void ArucoStatistics::countMarkers(std::size_t detected, std::size_t unsubscribed) {
+    detected_markers_.fetch_add(detected, std::memory_order_relaxed);
+    unsubscribed_markers_.fetch_add(unsubscribed, std::memory_order_relaxed);
+}
+
+void ArucoStatistics::recordReprojectionError(double pixel) {
+    if (!std::isfinite(pixel)) {
+        return;
+    }
+    reprojection_error_count_.fetch_add(1, std::memory_order_relaxed);
+    reprojection_error_sum_.fetch_add(static_cast<std::uint64_t>(pixel * 1e6), std::memory_order_relaxed);
+}
+
+double ArucoStatistics::meanReprojectionError() const {
+    auto count = reprojection_error_count_.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return 0;
+    }
+    return reprojection_error_sum_.load(std::memory_order_relaxed) / 1e6 / count;
+}
+
+bool ArucoStatistics::frameDone(int interval) {
+    auto frames = frames_.fetch_add(1, std::memory_order_relaxed) + 1;
+    return interval > 0 && frames % interval == 0;
+}
+
+LatencyHistogram::Summary ArucoStatistics::summarize(ArucoStage stage) const {
+    return histograms_[static_cast<std::size_t>(stage)].summarize();
+}
+
+void ArucoStatistics::logSummary(const std::string &name) const {
+    SPDLOG_INFO("{0} frames {1} detected markers {2} without subscriber {3}",
+                name,
+                frames_.load(std::memory_order_relaxed),
+                detected_markers_.load(std::memory_order_relaxed),
+                unsubscribed_markers_.load(std::memory_order_relaxed));
+    if (reprojection_error_count_.load(std::memory_order_relaxed) > 0) {
+        SPDLOG_INFO("{0} poses {1} mean reprojection error {2:.3f}px",
+                    name,
+                    reprojection_error_count_.load(std::memory_order_relaxed),
+                    meanReprojectionError());
+    }
+    for (std::size_t i = 0; i < histograms_.size(); ++i) {
+        auto summary = histograms_[i].summarize();
+        if (summary.count == 0) {
+            continue;
+        }
+        SPDLOG_INFO("{0} {1}: count {2} mean {3:.3f}ms p50 {4:.3f}ms p90 {5:.3f}ms p99 {6:.3f}ms max {7:.3f}ms",
+                    name,
+                    toString(static_cast<ArucoStage>(i)),
+                    summary.count,
+                    summary.mean_ms,
+                    summary.p50_ms,
+                    summary.p90_ms,
+                    summary.p99_ms,
+                    summary.max_ms);
+    }
+}
+
+StageTimer::StageTimer(ArucoStatistics &statistics, ArucoStage stage)
+    : statistics_(statistics), stage_(stage), start_(std::chrono::steady_clock::now()) {}
+
+StageTimer::StageTimer(StageTimer &parent, ArucoStage stage)
+    : statistics_(parent.statistics_), stage_(stage), parent_(&parent), start_(std::chrono::steady_clock::now()) {}
+
+StageTimer::~StageTimer() {
+    auto duration = std::chrono::steady_clock::now() - start_;
+    statistics_.record(stage_, duration - nested_);
+    if (parent_) {
+        parent_->nested_ += duration;
+    }
+}
+
+}
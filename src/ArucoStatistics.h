@@ -0,0 +1,113 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_ARUCOSTATISTICS_H
+#define TRAACTMULTI_ARUCOSTATISTICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace traact::component::aruco {
+
+enum class ArucoStage {
+    DETECTION = 0,
+    POSE_ESTIMATION,
+    OUTPUT_DISPATCH,
+    DEBUG_RENDERING,
+    COUNT
+};
+
+const char *toString(ArucoStage stage);
+
+/**
+ * Lock free latency histogram with four buckets per power of two microseconds.
+ * Safe to record from several threads, summaries are approximate while recording is in progress.
+ */
+class LatencyHistogram {
+ public:
+    static constexpr std::size_t kBucketCount = 128;
+
+    struct Summary {
+        std::uint64_t count{0};
+        double mean_ms{0};
+        double p50_ms{0};
+        double p90_ms{0};
+        double p99_ms{0};
+        double max_ms{0};
+    };
+
+    void record(std::chrono::nanoseconds duration);
+
+    Summary summarize() const;
+
+ private:
+    static std::size_t bucketIndex(std::uint64_t microseconds);
+    static double bucketUpperBoundMs(std::size_t index);
+
+    std::array<std::atomic<std::uint64_t>, kBucketCount> buckets_{};
+    std::atomic<std::uint64_t> count_{0};
+    std::atomic<std::uint64_t> total_ns_{0};
+    std::atomic<std::uint64_t> max_ns_{0};
+};
+
+/**
+ * Per stage latencies and marker counters of one aruco pipeline instance
+ */
+class ArucoStatistics {
+ public:
+    void record(ArucoStage stage, std::chrono::nanoseconds duration);
+
+    void countMarkers(std::size_t detected, std::size_t unsubscribed);
+
+    void recordReprojectionError(double pixel);
+    /**
+     * @return mean reprojection error in pixel of all recorded poses
+     */
+    double meanReprojectionError() const;
+
+    /**
+     * @return true every interval frames, false if interval is 0
+     */
+    bool frameDone(int interval);
+
+    LatencyHistogram::Summary summarize(ArucoStage stage) const;
+
+    void logSummary(const std::string &name) const;
+
+ private:
+    std::array<LatencyHistogram, static_cast<std::size_t>(ArucoStage::COUNT)> histograms_;
+    std::atomic<std::uint64_t> frames_{0};
+    std::atomic<std::uint64_t> detected_markers_{0};
+    std::atomic<std::uint64_t> unsubscribed_markers_{0};
+    std::atomic<std::uint64_t> reprojection_error_count_{0};
+    // in micro pixel to stay lock free
+    std::atomic<std::uint64_t> reprojection_error_sum_{0};
+};
+
+/**
+ * Records the lifetime of the timer into a stage of the statistics
+ */
+class StageTimer {
+ public:
+    StageTimer(ArucoStatistics &statistics, ArucoStage stage);
+    /**
+     * Nested stage, its lifetime is recorded into stage and not counted in the stage of the parent
+     */
+    StageTimer(StageTimer &parent, ArucoStage stage);
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+    ~StageTimer();
+
+ private:
+    ArucoStatistics &statistics_;
+    ArucoStage stage_;
+    StageTimer *parent_{nullptr};
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::nanoseconds nested_{0};
+};
+
+}
+
+#endif //TRAACTMULTI_ARUCOSTATISTICS_H
@@ -0,0 +1,133 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "BoardLayout.h"
+#include <traact/traact.h>
+#include <numeric>
+
+namespace traact::component::aruco {
+
+void BoardLayout::setGrid(int markers_x,
+                          int markers_y,
+                          float marker_length,
+                          float marker_separation,
+                          int first_marker_id) {
+    type_ = BoardType::GRID;
+    size_ = cv::Size(markers_x, markers_y);
+    marker_length_ = marker_length;
+    marker_separation_ = marker_separation;
+    marker_ids_.resize(static_cast<std::size_t>(markers_x * markers_y));
+    std::iota(marker_ids_.begin(), marker_ids_.end(), first_marker_id);
+}
+
+void BoardLayout::setCharuco(int squares_x,
+                             int squares_y,
+                             float square_length,
+                             float marker_length,
+                             int first_marker_id) {
+    type_ = BoardType::CHARUCO;
+    size_ = cv::Size(squares_x, squares_y);
+    square_length_ = square_length;
+    marker_length_ = marker_length;
+    // markers are placed on the white squares
+    marker_ids_.resize(static_cast<std::size_t>(squares_x * squares_y / 2));
+    std::iota(marker_ids_.begin(), marker_ids_.end(), first_marker_id);
+}
+
+bool BoardLayout::loadCustom(const std::string &filename) {
+    type_ = BoardType::CUSTOM;
+    marker_ids_.clear();
+    custom_corners_.clear();
+
+    cv::FileStorage file(filename, cv::FileStorage::READ);
+    if (!file.isOpened()) {
+        SPDLOG_ERROR("BoardLayout could not open board file {0}", filename);
+        return false;
+    }
+    file["ids"] >> marker_ids_;
+
+    auto corners_node = file["corners"];
+    for (auto corner_node : corners_node) {
+        std::vector<float> values;
+        corner_node >> values;
+        if (values.size() != 12) {
+            SPDLOG_ERROR("BoardLayout board file {0} needs 12 corner values per marker", filename);
+            return false;
+        }
+        std::vector<cv::Point3f> corners;
+        for (std::size_t i = 0; i < 12; i += 3) {
+            corners.emplace_back(values[i], values[i + 1], values[i + 2]);
+        }
+        custom_corners_.emplace_back(std::move(corners));
+    }
+
+    if (marker_ids_.empty() || marker_ids_.size() != custom_corners_.size()) {
+        SPDLOG_ERROR("BoardLayout board file {0} has {1} ids and {2} corner sets",
+                     filename, marker_ids_.size(), custom_corners_.size());
+        marker_ids_.clear();
+        custom_corners_.clear();
+        return false;
+    }
+    return true;
+}
+
+BoardType BoardLayout::type() const {
+    return type_;
+}
+
+const std::vector<int> &BoardLayout::markerIds() const {
+    return marker_ids_;
+}
+
+void BoardLayout::build(const cv::aruco::Dictionary &dictionary) {
+    charuco_detector_.reset();
+    switch (type_) {
+        case BoardType::GRID: {
+            board_ = std::make_unique<cv::aruco::GridBoard>(size_, marker_length_, marker_separation_,
+                                                            dictionary, marker_ids_);
+            break;
+        }
+        case BoardType::CHARUCO: {
+            cv::aruco::CharucoBoard charuco_board(size_, square_length_, marker_length_, dictionary, marker_ids_);
+            charuco_detector_ = std::make_unique<cv::aruco::CharucoDetector>(charuco_board);
+            board_ = std::make_unique<cv::aruco::CharucoBoard>(charuco_board);
+            break;
+        }
+        case BoardType::CUSTOM: {
+            board_ = std::make_unique<cv::aruco::Board>(custom_corners_, dictionary, marker_ids_);
+            break;
+        }
+    }
+}
+
+bool BoardLayout::isBuilt() const {
+    return board_ != nullptr;
+}
+
+void BoardLayout::matchImagePoints(const cv::Mat &image,
+                                   const std::vector<std::vector<cv::Point2f>> &markers,
+                                   const std::vector<int32_t> &marker_ids,
+                                   std::vector<cv::Point3f> &object_points,
+                                   std::vector<cv::Point2f> &image_points) const {
+    object_points.clear();
+    image_points.clear();
+    if (!board_ || marker_ids.empty()) {
+        return;
+    }
+
+    if (charuco_detector_) {
+        // detectBoard skips the marker detection when marker corners are given
+        auto charuco_markers = markers;
+        auto charuco_marker_ids = marker_ids;
+        std::vector<cv::Point2f> charuco_corners;
+        std::vector<int> charuco_ids;
+        charuco_detector_->detectBoard(image, charuco_corners, charuco_ids, charuco_markers, charuco_marker_ids);
+        if (charuco_ids.empty()) {
+            return;
+        }
+        board_->matchImagePoints(charuco_corners, charuco_ids, object_points, image_points);
+    } else {
+        board_->matchImagePoints(markers, marker_ids, object_points, image_points);
+    }
+}
+
+}
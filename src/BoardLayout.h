@@ -0,0 +1,67 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_BOARDLAYOUT_H
+#define TRAACTMULTI_BOARDLAYOUT_H
+
+#include <opencv2/aruco.hpp>
+#include <opencv2/objdetect/charuco_detector.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace traact::component::aruco {
+
+enum class BoardType {
+    GRID = 0,
+    CHARUCO,
+    CUSTOM
+};
+
+/**
+ * Description of a rigid body carrying several markers. The marker ids are known after configuration,
+ * the OpenCV board is created once the dictionary of the input is known.
+ */
+class BoardLayout {
+ public:
+    void setGrid(int markers_x, int markers_y, float marker_length, float marker_separation, int first_marker_id);
+    void setCharuco(int squares_x, int squares_y, float square_length, float marker_length, int first_marker_id);
+    /**
+     * Load a custom layout from a OpenCV FileStorage file containing
+     * "ids": sequence of marker ids and
+     * "corners": sequence of 12 values per marker, the 3D corners in the order of the detected corners
+     */
+    bool loadCustom(const std::string &filename);
+
+    BoardType type() const;
+    const std::vector<int> &markerIds() const;
+
+    void build(const cv::aruco::Dictionary &dictionary);
+    bool isBuilt() const;
+
+    /**
+     * Collect the 3D-2D correspondences of all visible board corners.
+     * For ChArUco boards the chessboard corners are interpolated from the detected markers.
+     */
+    void matchImagePoints(const cv::Mat &image,
+                          const std::vector<std::vector<cv::Point2f>> &markers,
+                          const std::vector<int32_t> &marker_ids,
+                          std::vector<cv::Point3f> &object_points,
+                          std::vector<cv::Point2f> &image_points) const;
+
+ private:
+    BoardType type_{BoardType::GRID};
+    cv::Size size_{4, 3};
+    float square_length_{0.04f};
+    float marker_length_{0.04f};
+    float marker_separation_{0.01f};
+    std::vector<int> marker_ids_;
+    std::vector<std::vector<cv::Point3f>> custom_corners_;
+
+    std::unique_ptr<cv::aruco::Board> board_;
+    std::unique_ptr<cv::aruco::CharucoDetector> charuco_detector_;
+
+};
+
+}
+
+#endif //TRAACTMULTI_BOARDLAYOUT_H
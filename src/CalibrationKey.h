@@ -0,0 +1,91 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_CALIBRATIONKEY_H
+#define TRAACTMULTI_CALIBRATIONKEY_H
+
+#include <traact/vision.h>
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+namespace traact::component::aruco {
+
+/**
+ * Identifies a camera calibration together with the image size it is applied to.
+ * Used to decide whether calibration derived state (camera matrices, detectors) can be reused.
+ *
+ * Stores the calibration values in fixed size arrays, so a key can be made every frame without allocating.
+ * The arrays hold all 14 coefficients of the OpenCV camera model: radial distortion k1 to k6 followed by the thin
+ * prism and tilt coefficients, and tangential distortion p1 and p2. A calibration with more coefficients makes an
+ * incomplete key, which is logged once and never equal to another key, so no state is shared on a partial match.
+ */
+struct CalibrationKey {
+    static constexpr std::size_t kMaxRadialDistortion = 12;
+    static constexpr std::size_t kMaxTangentialDistortion = 2;
+
+    bool complete{true};
+    int image_width{0};
+    int image_height{0};
+    int width{0};
+    int height{0};
+    double fx{0};
+    double fy{0};
+    double cx{0};
+    double cy{0};
+    double skew{0};
+    std::size_t radial_distortion_count{0};
+    std::array<double, kMaxRadialDistortion> radial_distortion{};
+    std::size_t tangential_distortion_count{0};
+    std::array<double, kMaxTangentialDistortion> tangential_distortion{};
+
+    bool operator==(const CalibrationKey &other) const {
+        return complete && other.complete
+            && image_width == other.image_width && image_height == other.image_height
+            && width == other.width && height == other.height
+            && fx == other.fx && fy == other.fy && cx == other.cx && cy == other.cy && skew == other.skew
+            && radial_distortion_count == other.radial_distortion_count
+            && radial_distortion == other.radial_distortion
+            && tangential_distortion_count == other.tangential_distortion_count
+            && tangential_distortion == other.tangential_distortion;
+    }
+    bool operator!=(const CalibrationKey &other) const {
+        return !(*this == other);
+    }
+};
+
+inline CalibrationKey makeCalibrationKey(const vision::CameraCalibration &calibration, const cv::Size &image_size) {
+    CalibrationKey key;
+    key.image_width = image_size.width;
+    key.image_height = image_size.height;
+    key.width = calibration.width;
+    key.height = calibration.height;
+    key.fx = calibration.fx;
+    key.fy = calibration.fy;
+    key.cx = calibration.cx;
+    key.cy = calibration.cy;
+    key.skew = calibration.skew;
+    key.complete = calibration.radial_distortion.size() <= key.radial_distortion.size()
+        && calibration.tangential_distortion.size() <= key.tangential_distortion.size();
+    if (!key.complete) {
+        static std::atomic<bool> logged{false};
+        if (!logged.exchange(true, std::memory_order_relaxed)) {
+            SPDLOG_WARN("calibration with {0} radial and {1} tangential distortion coefficients exceeds the {2} and {3} "
+                        "of the calibration key, calibration derived state is rebuilt every frame",
+                        calibration.radial_distortion.size(), calibration.tangential_distortion.size(),
+                        key.radial_distortion.size(), key.tangential_distortion.size());
+        }
+    }
+    key.radial_distortion_count = std::min(calibration.radial_distortion.size(), key.radial_distortion.size());
+    std::copy_n(calibration.radial_distortion.begin(), key.radial_distortion_count, key.radial_distortion.begin());
+    key.tangential_distortion_count =
+        std::min(calibration.tangential_distortion.size(), key.tangential_distortion.size());
+    std::copy_n(calibration.tangential_distortion.begin(),
+                key.tangential_distortion_count,
+                key.tangential_distortion.begin());
+    return key;
+}
+
+}
+
+#endif //TRAACTMULTI_CALIBRATIONKEY_H
@@ -0,0 +1,181 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "DetectionPipeline.h"
+#include <algorithm>
+
+namespace traact::component::aruco {
+
+DetectionPipeline::DetectionPipeline(int workers,
+                                     int max_frames_in_flight,
+                                     DropPolicy drop_policy,
+                                     const DetectorFactory &detector_factory,
+                                     DetectFunction detect,
+                                     EmitFunction emit)
+    : max_frames_in_flight_(static_cast<std::size_t>(std::max(1, max_frames_in_flight))),
+      drop_policy_(drop_policy),
+      detect_(std::move(detect)),
+      emit_(std::move(emit)) {
+    for (int i = 0; i < std::max(1, workers); ++i) {
+        detectors_.emplace_back(detector_factory());
+    }
+    for (auto &detector : detectors_) {
+        workers_.emplace_back(&DetectionPipeline::workerLoop, this, std::ref(*detector));
+    }
+    emitter_ = std::thread(&DetectionPipeline::emitterLoop, this);
+}
+
+DetectionPipeline::~DetectionPipeline() {
+    stop();
+}
+
+std::unique_ptr<PipelineFrame> DetectionPipeline::acquireFrame() {
+    {
+        std::lock_guard guard(mutex_);
+        if (!free_frames_.empty()) {
+            auto frame = std::move(free_frames_.back());
+            free_frames_.pop_back();
+            return frame;
+        }
+    }
+    return std::make_unique<PipelineFrame>();
+}
+
+bool DetectionPipeline::submit(std::unique_ptr<PipelineFrame> frame) {
+    std::unique_lock lock(mutex_);
+    if (stopping_) {
+        return false;
+    }
+
+    if (frame->valid) {
+        while (frames_in_flight_ >= max_frames_in_flight_ && frame->valid) {
+            if (drop_policy_ == DropPolicy::DROP_NEWEST) {
+                dropFrame(*frame);
+            } else if (drop_policy_ == DropPolicy::DROP_OLDEST && !pending_frames_.empty()) {
+                auto oldest = std::move(pending_frames_.front());
+                pending_frames_.pop_front();
+                dropFrame(*oldest.frame);
+                --frames_in_flight_;
+                done_frames_.emplace(oldest.sequence, std::move(oldest.frame));
+                result_available_.notify_one();
+            } else {
+                // all frames in flight are being detected, nothing left to drop
+                space_available_.wait(lock);
+                if (stopping_) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    // the sequence is taken after waiting, the emitter never waits for a frame that is not submitted yet
+    auto sequence = next_sequence_++;
+
+    if (frame->valid) {
+        ++frames_in_flight_;
+        pending_frames_.push_back(PendingFrame{sequence, std::move(frame)});
+        work_available_.notify_one();
+    } else {
+        done_frames_.emplace(sequence, std::move(frame));
+        result_available_.notify_one();
+    }
+    return true;
+}
+
+void DetectionPipeline::stop() {
+    {
+        std::lock_guard guard(mutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+    result_available_.notify_all();
+    space_available_.notify_all();
+
+    for (auto &worker : workers_) {
+        worker.join();
+    }
+    emitter_.join();
+    SPDLOG_INFO("DetectionPipeline stopped, {0} dropped frames", dropped_frames_);
+}
+
+std::uint64_t DetectionPipeline::droppedFrames() const {
+    std::lock_guard guard(mutex_);
+    return dropped_frames_;
+}
+
+void DetectionPipeline::workerLoop(SquareMarkerDetector &detector) {
+    while (true) {
+        PendingFrame pending;
+        {
+            std::unique_lock lock(mutex_);
+            work_available_.wait(lock, [this] { return stopping_ || !pending_frames_.empty(); });
+            // pending frames are still detected when stopping, so every submitted frame gets emitted
+            if (pending_frames_.empty()) {
+                return;
+            }
+            pending = std::move(pending_frames_.front());
+            pending_frames_.pop_front();
+        }
+
+        detect_(*pending.frame, detector);
+
+        {
+            std::lock_guard guard(mutex_);
+            done_frames_.emplace(pending.sequence, std::move(pending.frame));
+        }
+        result_available_.notify_one();
+    }
+}
+
+void DetectionPipeline::emitterLoop() {
+    while (true) {
+        std::unique_ptr<PipelineFrame> frame;
+        {
+            std::unique_lock lock(mutex_);
+            result_available_.wait(lock, [this] {
+                return done_frames_.count(next_emit_sequence_) > 0
+                    || (stopping_ && next_emit_sequence_ == next_sequence_);
+            });
+            auto next = done_frames_.find(next_emit_sequence_);
+            if (next == done_frames_.end()) {
+                return;
+            }
+            frame = std::move(next->second);
+            done_frames_.erase(next);
+            ++next_emit_sequence_;
+        }
+
+        emit_(*frame);
+
+        auto was_in_flight = frame->valid;
+        {
+            std::lock_guard guard(mutex_);
+            if (was_in_flight) {
+                --frames_in_flight_;
+            }
+            // one frame per slot in flight is enough to feed the submitting thread
+            if (free_frames_.size() < max_frames_in_flight_) {
+                frame->valid = false;
+                // images wrapping memory of the caller must not be written by the next user of the frame
+                if (!frame->image.u) {
+                    frame->image.release();
+                }
+                free_frames_.push_back(std::move(frame));
+            }
+        }
+        if (was_in_flight) {
+            space_available_.notify_one();
+        }
+    }
+}
+
+void DetectionPipeline::dropFrame(PipelineFrame &frame) {
+    frame.valid = false;
+    frame.image.release();
+    ++dropped_frames_;
+    SPDLOG_TRACE("DetectionPipeline drop frame {0}", frame.ts.time_since_epoch().count());
+}
+
+}
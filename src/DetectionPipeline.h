@@ -0,0 +1,126 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_DETECTIONPIPELINE_H
+#define TRAACTMULTI_DETECTIONPIPELINE_H
+
+#include <traact/traact.h>
+#include <traact/vision.h>
+#include <opencv2/core.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "MarkerFrame.h"
+#include "SquareMarkerDetector.h"
+
+namespace traact::component::aruco {
+
+enum class DropPolicy {
+    /**
+     * wait for a free slot, the caller is stalled
+     */
+    BLOCK = 0,
+    /**
+     * the new frame is emitted as invalid
+     */
+    DROP_NEWEST,
+    /**
+     * the oldest frame not yet picked up by a worker is emitted as invalid
+     */
+    DROP_OLDEST
+};
+
+/**
+ * One time point passing through the pipeline. Frames without valid input or dropped frames have valid == false.
+ */
+struct PipelineFrame {
+    Timestamp ts;
+    bool valid{false};
+    cv::Mat image;
+    vision::CameraCalibration calibration;
+    double marker_size{0};
+    MarkerFrame frame;
+};
+
+/**
+ * Detects frames concurrently on a bounded pool of workers, each with its own detector, and emits the results
+ * on a single thread in strict submission order.
+ *
+ * At most max_frames_in_flight valid frames are submitted but not yet emitted, the drop policy decides what
+ * happens to further frames.
+ */
+class DetectionPipeline {
+ public:
+    using DetectorFactory = std::function<std::unique_ptr<SquareMarkerDetector>()>;
+    using DetectFunction = std::function<void(PipelineFrame &, SquareMarkerDetector &)>;
+    using EmitFunction = std::function<void(PipelineFrame &)>;
+
+    DetectionPipeline(int workers,
+                      int max_frames_in_flight,
+                      DropPolicy drop_policy,
+                      const DetectorFactory &detector_factory,
+                      DetectFunction detect,
+                      EmitFunction emit);
+    DetectionPipeline(const DetectionPipeline &) = delete;
+    DetectionPipeline &operator=(const DetectionPipeline &) = delete;
+    ~DetectionPipeline();
+
+    /**
+     * Frame of an earlier emission with its image and result buffers, or a new frame. Frames passed to submit are
+     * recycled after they were emitted, so a steady stream of frames reuses the same buffers.
+     */
+    std::unique_ptr<PipelineFrame> acquireFrame();
+
+    /**
+     * @return false if the pipeline is stopping, the frame is discarded and the caller has to send its time point
+     * as invalid
+     */
+    bool submit(std::unique_ptr<PipelineFrame> frame);
+
+    /**
+     * Detect and emit all submitted frames, then join the threads
+     */
+    void stop();
+
+    std::uint64_t droppedFrames() const;
+
+ private:
+    struct PendingFrame {
+        std::uint64_t sequence;
+        std::unique_ptr<PipelineFrame> frame;
+    };
+
+    void workerLoop(SquareMarkerDetector &detector);
+    void emitterLoop();
+    void dropFrame(PipelineFrame &frame);
+
+    const std::size_t max_frames_in_flight_;
+    const DropPolicy drop_policy_;
+    DetectFunction detect_;
+    EmitFunction emit_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable result_available_;
+    std::condition_variable space_available_;
+    std::deque<PendingFrame> pending_frames_;
+    std::map<std::uint64_t, std::unique_ptr<PipelineFrame>> done_frames_;
+    std::vector<std::unique_ptr<PipelineFrame>> free_frames_;
+    std::uint64_t next_sequence_{0};
+    std::uint64_t next_emit_sequence_{0};
+    std::size_t frames_in_flight_{0};
+    std::uint64_t dropped_frames_{0};
+    bool stopping_{false};
+
+    std::vector<std::unique_ptr<SquareMarkerDetector>> detectors_;
+    std::vector<std::thread> workers_;
+    std::thread emitter_;
+};
+
+}
+
+#endif //TRAACTMULTI_DETECTIONPIPELINE_H
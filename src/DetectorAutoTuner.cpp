@@ -0,0 +1,166 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "DetectorAutoTuner.h"
+#include <traact/traact.h>
+#include <algorithm>
+
+namespace traact::component::aruco {
+
+namespace {
+// fraction of the initial detection rate a cheaper setting has to keep
+constexpr double kMinMarkerRateRatio = 0.95;
+// markers may come this much closer than the largest one seen while tuning
+constexpr double kMaxPerimeterMargin = 1.5;
+}
+
+DetectorAutoTuner::DetectorAutoTuner(const cv::aruco::DetectorParameters &parameters,
+                                     double budget_ms,
+                                     std::string tune_file,
+                                     int window_frames)
+    : parameters_(parameters),
+      previous_parameters_(parameters),
+      budget_ms_(budget_ms),
+      tune_file_(std::move(tune_file)),
+      window_frames_(std::max(1, window_frames)) {
+    // ordered by the expected loss of markers, each step returns false if it changes nothing
+    steps_.emplace_back([](cv::aruco::DetectorParameters &p) {
+        auto step = std::max(p.adaptiveThreshWinSizeStep,
+                             (p.adaptiveThreshWinSizeMax - p.adaptiveThreshWinSizeMin) / 2);
+        if (step == p.adaptiveThreshWinSizeStep) {
+            return false;
+        }
+        p.adaptiveThreshWinSizeStep = step;
+        return true;
+    });
+    steps_.emplace_back([](cv::aruco::DetectorParameters &p) {
+        if (p.adaptiveThreshWinSizeMin == p.adaptiveThreshWinSizeMax) {
+            return false;
+        }
+        // single window in the middle of the range, window sizes have to be odd
+        auto window = ((p.adaptiveThreshWinSizeMin + p.adaptiveThreshWinSizeMax) / 2) | 1;
+        p.adaptiveThreshWinSizeMin = window;
+        p.adaptiveThreshWinSizeMax = window;
+        return true;
+    });
+    steps_.emplace_back([](cv::aruco::DetectorParameters &p) {
+        if (p.minMarkerPerimeterRate >= 0.05) {
+            return false;
+        }
+        p.minMarkerPerimeterRate = 0.05;
+        return true;
+    });
+    steps_.emplace_back([this](cv::aruco::DetectorParameters &p) {
+        // large contours are expensive to approximate and decode, skip those larger than any marker seen
+        if (max_perimeter_rate_ <= 0) {
+            return false;
+        }
+        auto max_rate = std::max(kMaxPerimeterMargin * max_perimeter_rate_, 2 * p.minMarkerPerimeterRate);
+        if (max_rate >= p.maxMarkerPerimeterRate) {
+            return false;
+        }
+        p.maxMarkerPerimeterRate = max_rate;
+        return true;
+    });
+    steps_.emplace_back([](cv::aruco::DetectorParameters &p) {
+        if (p.cornerRefinementMethod == cv::aruco::CORNER_REFINE_NONE) {
+            return false;
+        }
+        p.cornerRefinementMethod = cv::aruco::CORNER_REFINE_NONE;
+        return true;
+    });
+}
+
+bool DetectorAutoTuner::load(const std::string &tune_file, cv::aruco::DetectorParameters &parameters) {
+    if (tune_file.empty()) {
+        return false;
+    }
+    cv::FileStorage file(tune_file, cv::FileStorage::READ);
+    if (!file.isOpened()) {
+        return false;
+    }
+    return parameters.readDetectorParameters(file.root());
+}
+
+bool DetectorAutoTuner::isConverged() const {
+    return converged_;
+}
+
+const cv::aruco::DetectorParameters &DetectorAutoTuner::parameters() const {
+    return parameters_;
+}
+
+bool DetectorAutoTuner::frameDone(std::chrono::nanoseconds detection_time,
+                                  std::size_t subscribed_markers,
+                                  double max_perimeter_rate) {
+    if (converged_) {
+        return false;
+    }
+    max_perimeter_rate_ = std::max(max_perimeter_rate_, max_perimeter_rate);
+    time_sum_ms_ += std::chrono::duration<double, std::milli>(detection_time).count();
+    marker_sum_ += subscribed_markers;
+    if (++frames_ < window_frames_) {
+        return false;
+    }
+
+    auto mean_ms = time_sum_ms_ / frames_;
+    auto marker_rate = static_cast<double>(marker_sum_) / frames_;
+    frames_ = 0;
+    time_sum_ms_ = 0;
+    marker_sum_ = 0;
+
+    SPDLOG_DEBUG("DetectorAutoTuner step {0}: detection {1:.3f}ms, {2:.2f} subscribed markers per frame",
+                 step_index_, mean_ms, marker_rate);
+
+    if (baseline_marker_rate_ < 0) {
+        baseline_marker_rate_ = marker_rate;
+    } else if (marker_rate < kMinMarkerRateRatio * baseline_marker_rate_) {
+        parameters_ = previous_parameters_;
+        converge("lost markers, reverted last step");
+        return true;
+    }
+
+    if (mean_ms <= budget_ms_) {
+        converge("within budget");
+        return false;
+    }
+    if (!nextStep()) {
+        converge("no cheaper setting left");
+        return false;
+    }
+    return true;
+}
+
+bool DetectorAutoTuner::nextStep() {
+    while (step_index_ < steps_.size()) {
+        auto candidate = parameters_;
+        if (steps_[step_index_++](candidate)) {
+            previous_parameters_ = parameters_;
+            parameters_ = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void DetectorAutoTuner::converge(const char *reason) {
+    converged_ = true;
+    SPDLOG_INFO("DetectorAutoTuner converged after {0} steps: {1}, threshold windows {2}-{3} step {4}, "
+                "perimeter rate {5}-{6}, corner refinement {7}",
+                step_index_, reason,
+                parameters_.adaptiveThreshWinSizeMin,
+                parameters_.adaptiveThreshWinSizeMax,
+                parameters_.adaptiveThreshWinSizeStep,
+                parameters_.minMarkerPerimeterRate,
+                parameters_.maxMarkerPerimeterRate,
+                static_cast<int>(parameters_.cornerRefinementMethod));
+
+    if (tune_file_.empty()) {
+        return;
+    }
+    cv::FileStorage file(tune_file_, cv::FileStorage::WRITE);
+    if (!file.isOpened() || !parameters_.writeDetectorParameters(file)) {
+        SPDLOG_ERROR("DetectorAutoTuner could not write {0}", tune_file_);
+    }
+}
+
+}
@@ -0,0 +1,76 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_DETECTORAUTOTUNER_H
+#define TRAACTMULTI_DETECTORAUTOTUNER_H
+
+#include <opencv2/aruco.hpp>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace traact::component::aruco {
+
+/**
+ * Online tuning of the detector parameters for a time budget per frame.
+ *
+ * Starting from the configured parameters, a fixed sequence of cheaper settings is tried: fewer adaptive
+ * threshold windows, a single window, a larger minimal perimeter rate, a maximal perimeter rate fitted to the
+ * largest marker seen so far and no corner refinement. Each setting
+ * is measured over a window of frames. Tuning stops as soon as the mean detection time is within the budget,
+ * or steps back to the previous setting if the detection rate of subscribed markers drops below the rate of the
+ * initial parameters.
+ *
+ * Once converged the parameters are written to the tune file, if set, so later runs can start with them.
+ */
+class DetectorAutoTuner {
+ public:
+    DetectorAutoTuner(const cv::aruco::DetectorParameters &parameters,
+                      double budget_ms,
+                      std::string tune_file,
+                      int window_frames = 30);
+
+    /**
+     * Read parameters from a previous run
+     * @return false if the file does not exist or can not be read
+     */
+    static bool load(const std::string &tune_file, cv::aruco::DetectorParameters &parameters);
+
+    bool isConverged() const;
+    const cv::aruco::DetectorParameters &parameters() const;
+
+    /**
+     * @param subscribed_markers number of detected markers someone listens to
+     * @param max_perimeter_rate largest perimeter of the subscribed markers relative to the larger image side
+     * @return true if parameters() changed and have to be applied to the detector
+     */
+    bool frameDone(std::chrono::nanoseconds detection_time, std::size_t subscribed_markers, double max_perimeter_rate);
+
+ private:
+    using TuneStep = std::function<bool(cv::aruco::DetectorParameters &)>;
+
+    bool nextStep();
+    void converge(const char *reason);
+
+    std::vector<TuneStep> steps_;
+    std::size_t step_index_{0};
+    cv::aruco::DetectorParameters parameters_;
+    cv::aruco::DetectorParameters previous_parameters_;
+    double budget_ms_;
+    std::string tune_file_;
+    int window_frames_;
+
+    bool converged_{false};
+    int frames_{0};
+    double time_sum_ms_{0};
+    std::size_t marker_sum_{0};
+    double baseline_marker_rate_{-1};
+    /**
+     * largest perimeter rate of a subscribed marker since tuning started
+     */
+    double max_perimeter_rate_{0};
+};
+
+}
+
+#endif //TRAACTMULTI_DETECTORAUTOTUNER_H
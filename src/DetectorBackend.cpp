@@ -0,0 +1,142 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "DetectorBackend.h"
+#include <traact/traact.h>
+#include <string>
+
+namespace traact::component::aruco {
+
+namespace {
+
+bool isSameDictionary(const cv::aruco::Dictionary &dictionary, cv::aruco::PredefinedDictionaryType type) {
+    auto predefined = cv::aruco::getPredefinedDictionary(type);
+    return dictionary.markerSize == predefined.markerSize
+        && dictionary.bytesList.size == predefined.bytesList.size
+        && cv::norm(dictionary.bytesList, predefined.bytesList, cv::NORM_INF) == 0;
+}
+
+/**
+ * @return name of the aruco library dictionary with the same markers and ids, empty if there is none
+ */
+std::string arucoLibDictionaryName(const cv::aruco::Dictionary &dictionary) {
+    const std::pair<cv::aruco::PredefinedDictionaryType, const char *> dictionaries[] = {
+        {cv::aruco::DICT_ARUCO_ORIGINAL, "ARUCO"},
+        {cv::aruco::DICT_APRILTAG_16h5, "TAG16h5"},
+        {cv::aruco::DICT_APRILTAG_25h9, "TAG25h9"},
+        {cv::aruco::DICT_APRILTAG_36h10, "TAG36h10"},
+        {cv::aruco::DICT_APRILTAG_36h11, "TAG36h11"},
+        {cv::aruco::DICT_ARUCO_MIP_36h12, "ARUCO_MIP_36h12"}};
+    for (const auto &[type, name] : dictionaries) {
+        if (isSameDictionary(dictionary, type)) {
+            return name;
+        }
+    }
+    return {};
+}
+
+}
+
+OpenCVDetectorBackend::OpenCVDetectorBackend(const cv::aruco::Dictionary &dictionary,
+                                             const cv::aruco::DetectorParameters &parameters)
+    : detector_(dictionary, parameters) {}
+
+bool OpenCVDetectorBackend::setDictionary(const cv::aruco::Dictionary &dictionary) {
+    detector_.setDictionary(dictionary);
+    return true;
+}
+
+void OpenCVDetectorBackend::setParameters(const cv::aruco::DetectorParameters &parameters) {
+    detector_.setDetectorParameters(parameters);
+}
+
+void OpenCVDetectorBackend::detect(const cv::Mat &image,
+                                   MarkerCorners &markers,
+                                   MarkerIds &marker_ids,
+                                   MarkerCorners *rejected) {
+    if (rejected) {
+        detector_.detectMarkers(image, markers, marker_ids, *rejected);
+    } else {
+        detector_.detectMarkers(image, markers, marker_ids);
+    }
+}
+
+bool OpenCVDetectorBackend::supportsRejected() const {
+    return true;
+}
+
+ArucoLibDetectorBackend::ArucoLibDetectorBackend(::aruco::DetectionMode detection_mode)
+    : detection_mode_(detection_mode) {}
+
+bool ArucoLibDetectorBackend::setDictionary(const cv::aruco::Dictionary &dictionary) {
+    dictionary_name_ = arucoLibDictionaryName(dictionary);
+    if (dictionary_name_.empty()) {
+        return false;
+    }
+    detector_.setDictionary(dictionary_name_, error_correction_rate_);
+    return true;
+}
+
+void ArucoLibDetectorBackend::setParameters(const cv::aruco::DetectorParameters &parameters) {
+    auto &aruco_parameters = detector_.getParameters();
+    // minSize is the side length relative to the larger image side, the OpenCV rate is the perimeter
+    aruco_parameters.setDetectionMode(detection_mode_, static_cast<float>(parameters.minMarkerPerimeterRate / 4));
+    switch (parameters.cornerRefinementMethod) {
+        case cv::aruco::CORNER_REFINE_SUBPIX:aruco_parameters.setCornerRefinementMethod(::aruco::CORNER_SUBPIX);
+            break;
+        case cv::aruco::CORNER_REFINE_CONTOUR:aruco_parameters.setCornerRefinementMethod(::aruco::CORNER_LINES);
+            break;
+        default:aruco_parameters.setCornerRefinementMethod(::aruco::CORNER_NONE);
+            break;
+    }
+
+    auto error_correction_rate = static_cast<float>(parameters.errorCorrectionRate);
+    if (error_correction_rate != error_correction_rate_) {
+        error_correction_rate_ = error_correction_rate;
+        if (!dictionary_name_.empty()) {
+            detector_.setDictionary(dictionary_name_, error_correction_rate_);
+        }
+    }
+}
+
+void ArucoLibDetectorBackend::detect(const cv::Mat &image,
+                                     MarkerCorners &markers,
+                                     MarkerIds &marker_ids,
+                                     MarkerCorners *rejected) {
+    detector_.detect(image, detected_markers_);
+    markers.resize(detected_markers_.size());
+    marker_ids.resize(detected_markers_.size());
+    for (std::size_t i = 0; i < detected_markers_.size(); ++i) {
+        // same corner order as OpenCV, clockwise from the top left corner of the marker
+        markers[i].assign(detected_markers_[i].begin(), detected_markers_[i].end());
+        marker_ids[i] = detected_markers_[i].id;
+    }
+    if (rejected) {
+        rejected->clear();
+    }
+}
+
+bool ArucoLibDetectorBackend::supportsRejected() const {
+    return false;
+}
+
+bool isDictionarySupported(DetectorBackendType type, const cv::aruco::Dictionary &dictionary) {
+    return type == DetectorBackendType::OPENCV || !arucoLibDictionaryName(dictionary).empty();
+}
+
+std::unique_ptr<DetectorBackend> createDetectorBackend(DetectorBackendType type,
+                                                       const cv::aruco::Dictionary &dictionary,
+                                                       const cv::aruco::DetectorParameters &parameters) {
+    if (type != DetectorBackendType::OPENCV) {
+        auto backend = std::make_unique<ArucoLibDetectorBackend>(
+            type == DetectorBackendType::ARUCO_VIDEO_FAST ? ::aruco::DM_VIDEO_FAST : ::aruco::DM_FAST);
+        backend->setParameters(parameters);
+        if (!backend->setDictionary(dictionary)) {
+            SPDLOG_ERROR("aruco library has no dictionary with the markers of the OpenCV dictionary");
+            return nullptr;
+        }
+        return backend;
+    }
+    return std::make_unique<OpenCVDetectorBackend>(dictionary, parameters);
+}
+
+}
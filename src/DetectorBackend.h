@@ -0,0 +1,109 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_DETECTORBACKEND_H
+#define TRAACTMULTI_DETECTORBACKEND_H
+
+#include <opencv2/aruco.hpp>
+#include <markerdetector.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace traact::component::aruco {
+
+enum class DetectorBackendType {
+    /**
+     * cv::aruco::ArucoDetector
+     */
+    OPENCV = 0,
+    /**
+     * ::aruco::MarkerDetector in DM_FAST mode, candidates are searched on a downscaled image pyramid level
+     */
+    ARUCO_FAST,
+    /**
+     * ::aruco::MarkerDetector in DM_VIDEO_FAST mode, additionally reuses threshold and marker size of the previous
+     * frame, for consecutive frames of one camera
+     */
+    ARUCO_VIDEO_FAST
+};
+
+/**
+ * Marker detection in a single channel image, corners and ids in the format of cv::aruco::ArucoDetector
+ */
+class DetectorBackend {
+ public:
+    using MarkerCorners = std::vector<std::vector<cv::Point2f>>;
+    using MarkerIds = std::vector<int32_t>;
+
+    virtual ~DetectorBackend() = default;
+
+    /**
+     * @return false if the backend can not decode the dictionary
+     */
+    virtual bool setDictionary(const cv::aruco::Dictionary &dictionary) = 0;
+    virtual void setParameters(const cv::aruco::DetectorParameters &parameters) = 0;
+
+    /**
+     * Replaces the content of markers and marker_ids, entries of markers keep their buffers where possible
+     *
+     * @param rejected candidates without a valid id, only filled if supportsRejected, may be nullptr
+     */
+    virtual void detect(const cv::Mat &image, MarkerCorners &markers, MarkerIds &marker_ids, MarkerCorners *rejected) = 0;
+
+    /**
+     * true if rejected candidates are reported, needed for DecodeMode::LOOKUP
+     */
+    virtual bool supportsRejected() const = 0;
+};
+
+class OpenCVDetectorBackend : public DetectorBackend {
+ public:
+    OpenCVDetectorBackend(const cv::aruco::Dictionary &dictionary, const cv::aruco::DetectorParameters &parameters);
+
+    bool setDictionary(const cv::aruco::Dictionary &dictionary) override;
+    void setParameters(const cv::aruco::DetectorParameters &parameters) override;
+    void detect(const cv::Mat &image, MarkerCorners &markers, MarkerIds &marker_ids, MarkerCorners *rejected) override;
+    bool supportsRejected() const override;
+
+ private:
+    cv::aruco::ArucoDetector detector_;
+};
+
+/**
+ * ::aruco::MarkerDetector of the aruco library. It decodes its own dictionaries, only the OpenCV dictionaries with
+ * an aruco library counterpart of identical ids are supported: ARUCO_ORIGINAL, the AprilTag families and
+ * ARUCO_MIP_36h12.
+ */
+class ArucoLibDetectorBackend : public DetectorBackend {
+ public:
+    explicit ArucoLibDetectorBackend(::aruco::DetectionMode detection_mode);
+
+    bool setDictionary(const cv::aruco::Dictionary &dictionary) override;
+    void setParameters(const cv::aruco::DetectorParameters &parameters) override;
+    void detect(const cv::Mat &image, MarkerCorners &markers, MarkerIds &marker_ids, MarkerCorners *rejected) override;
+    bool supportsRejected() const override;
+
+ private:
+    ::aruco::MarkerDetector detector_;
+    ::aruco::DetectionMode detection_mode_;
+    std::string dictionary_name_;
+    float error_correction_rate_{0};
+    std::vector<::aruco::Marker> detected_markers_;
+};
+
+/**
+ * true if a backend of the type can decode the dictionary, always true for OPENCV
+ */
+bool isDictionarySupported(DetectorBackendType type, const cv::aruco::Dictionary &dictionary);
+
+/**
+ * Backend of the requested type, nullptr if it does not support the dictionary. Check with isDictionarySupported
+ * while configuring.
+ */
+std::unique_ptr<DetectorBackend> createDetectorBackend(DetectorBackendType type,
+                                                       const cv::aruco::Dictionary &dictionary,
+                                                       const cv::aruco::DetectorParameters &parameters);
+
+}
+
+#endif //TRAACTMULTI_DETECTORBACKEND_H
@@ -0,0 +1,230 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "DictionaryIndex.h"
+#include <traact/traact.h>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <bitset>
+
+namespace traact::component::aruco {
+
+namespace {
+// codes up to this many flipped bits are stored in the table
+constexpr int kMaxIndexedCorrectionBits = 1;
+
+/**
+ * cv::aruco::Dictionary::identify tries the rotations of a marker counterclockwise
+ */
+int opencvRotation(int clockwise_rotation) {
+    return (4 - clockwise_rotation) % 4;
+}
+}
+
+bool DictionaryIndex::build(const cv::aruco::Dictionary &dictionary, double error_correction_rate) {
+    table_.clear();
+    codes_.clear();
+    marker_size_ = 0;
+    if (dictionary.markerSize * dictionary.markerSize > 64) {
+        SPDLOG_WARN("DictionaryIndex markers with {0} bits do not fit the index",
+                    dictionary.markerSize * dictionary.markerSize);
+        return false;
+    }
+    auto bit_count = dictionary.markerSize * dictionary.markerSize;
+    // same as cv::aruco::Dictionary::identify
+    auto correction_bits = static_cast<int>(dictionary.maxCorrectionBits * error_correction_rate);
+
+    codes_.reserve(dictionary.bytesList.rows * 4);
+    for (int marker_id = 0; marker_id < dictionary.bytesList.rows; ++marker_id) {
+        auto bits = cv::aruco::Dictionary::getBitsFromByteList(dictionary.bytesList.rowRange(marker_id, marker_id + 1),
+                                                                dictionary.markerSize);
+        for (int rotation = 0; rotation < 4; ++rotation) {
+            codes_.push_back(packBits(bits));
+            cv::rotate(bits, bits, cv::ROTATE_90_CLOCKWISE);
+        }
+    }
+
+    // the first marker within the correction distance is only the closest one if the markers are far enough apart
+    for (std::size_t i = 0; i < codes_.size(); i += 4) {
+        for (std::size_t j = i + 4; j < codes_.size(); ++j) {
+            if (distance(codes_[i], codes_[j]) <= 2 * correction_bits) {
+                SPDLOG_WARN("DictionaryIndex markers {0} and {1} are within twice the correction distance of {2} bits",
+                            i / 4, j / 4, correction_bits);
+                codes_.clear();
+                return false;
+            }
+        }
+    }
+
+    auto indexed_bits = std::min(correction_bits, kMaxIndexedCorrectionBits);
+    table_.reserve(codes_.size() * (indexed_bits > 0 ? bit_count + 1 : 1));
+    for (std::size_t i = 0; i < codes_.size(); ++i) {
+        Entry entry{static_cast<int>(i / 4), static_cast<int>(i % 4), 0};
+        insert(codes_[i], entry);
+        if (indexed_bits > 0) {
+            entry.distance = 1;
+            for (int bit = 0; bit < bit_count; ++bit) {
+                insert(codes_[i] ^ (std::uint64_t{1} << bit), entry);
+            }
+        }
+    }
+    marker_size_ = dictionary.markerSize;
+    correction_bits_ = correction_bits;
+
+    SPDLOG_INFO("DictionaryIndex {0} markers, {1} codes, {2} correction bits",
+                dictionary.bytesList.rows, table_.size(), correction_bits_);
+    return true;
+}
+
+bool DictionaryIndex::isBuilt() const {
+    return marker_size_ > 0;
+}
+
+std::size_t DictionaryIndex::size() const {
+    return table_.size();
+}
+
+bool DictionaryIndex::identify(const cv::Mat &image,
+                               std::vector<cv::Point2f> &corners,
+                               int &marker_id,
+                               const cv::aruco::DetectorParameters &parameters) {
+    if (!isBuilt() || corners.size() != 4 || !extractBits(image, corners, parameters)) {
+        return false;
+    }
+
+    Entry entry{};
+    if (!search(packBits(marker_bits_), entry)) {
+        return false;
+    }
+
+    // the candidate shows the marker rotated clockwise, its first corner is at position rotation
+    std::rotate(corners.begin(), corners.begin() + entry.rotation, corners.end());
+    marker_id = entry.marker_id;
+    return true;
+}
+
+bool DictionaryIndex::search(std::uint64_t code, Entry &entry) const {
+    auto found = table_.find(code);
+    if (found != table_.end()) {
+        entry = found->second;
+        return true;
+    }
+    if (correction_bits_ <= kMaxIndexedCorrectionBits) {
+        return false;
+    }
+
+    // more flipped bits than indexed, linear search in the order of cv::aruco::Dictionary::identify
+    for (std::size_t i = 0; i < codes_.size(); i += 4) {
+        Entry closest{-1, 0, correction_bits_ + 1};
+        for (int opencv_rotation = 0; opencv_rotation < 4; ++opencv_rotation) {
+            auto rotation = opencvRotation(opencv_rotation);
+            auto code_distance = distance(code, codes_[i + rotation]);
+            if (code_distance < closest.distance) {
+                closest = Entry{static_cast<int>(i / 4), rotation, code_distance};
+            }
+        }
+        if (closest.marker_id >= 0) {
+            entry = closest;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DictionaryIndex::extractBits(const cv::Mat &image,
+                                  const std::vector<cv::Point2f> &corners,
+                                  const cv::aruco::DetectorParameters &parameters) {
+    // same sampling as _extractBits of cv::aruco::ArucoDetector
+    auto border_bits = parameters.markerBorderBits;
+    auto cell_count = marker_size_ + 2 * border_bits;
+    auto cell_size = parameters.perspectiveRemovePixelPerCell;
+    auto warped_size = cell_count * cell_size;
+
+    const cv::Point2f destination[] = {
+        cv::Point2f(0, 0),
+        cv::Point2f(static_cast<float>(warped_size - 1), 0),
+        cv::Point2f(static_cast<float>(warped_size - 1), static_cast<float>(warped_size - 1)),
+        cv::Point2f(0, static_cast<float>(warped_size - 1))
+    };
+    auto transform = cv::getPerspectiveTransform(corners.data(), destination);
+    cv::warpPerspective(image, warped_image_, transform, cv::Size(warped_size, warped_size), cv::INTER_NEAREST);
+
+    auto inner_region = warped_image_(cv::Rect(cell_size / 2, cell_size / 2,
+                                                warped_size - cell_size, warped_size - cell_size));
+    cv::Scalar mean, standard_deviation;
+    cv::meanStdDev(inner_region, mean, standard_deviation);
+    if (standard_deviation[0] < parameters.minOtsuStdDev) {
+        // a uniform candidate is either all black or all white
+        bits_ = cv::Mat(cell_count, cell_count, CV_8UC1, cv::Scalar(mean[0] > 127 ? 1 : 0));
+    } else {
+        cv::threshold(warped_image_, threshold_image_, 125, 255, cv::THRESH_BINARY | cv::THRESH_OTSU);
+        bits_.create(cell_count, cell_count, CV_8UC1);
+        auto margin = static_cast<int>(cell_size * parameters.perspectiveRemoveIgnoredMarginPerCell);
+        auto cell_area = (cell_size - 2 * margin) * (cell_size - 2 * margin);
+        for (int y = 0; y < cell_count; ++y) {
+            for (int x = 0; x < cell_count; ++x) {
+                auto cell = threshold_image_(cv::Rect(x * cell_size + margin, y * cell_size + margin,
+                                                      cell_size - 2 * margin, cell_size - 2 * margin));
+                bits_.at<uchar>(y, x) = cv::countNonZero(cell) > cell_area / 2 ? 1 : 0;
+            }
+        }
+    }
+
+    // the border has to be black
+    int border_errors{0};
+    for (int y = 0; y < cell_count; ++y) {
+        for (int x = 0; x < cell_count; ++x) {
+            auto is_border = y < border_bits || x < border_bits
+                || y >= cell_count - border_bits || x >= cell_count - border_bits;
+            if (is_border && bits_.at<uchar>(y, x) != 0) {
+                ++border_errors;
+            }
+        }
+    }
+    // white markers on black background have a white border, as in cv::aruco::ArucoDetector
+    auto border_cells = cell_count * cell_count - marker_size_ * marker_size_;
+    if (parameters.detectInvertedMarker && border_cells - border_errors < border_errors) {
+        border_errors = border_cells - border_errors;
+        bits_ = 1 - bits_;
+    }
+    // opencv scales the allowed errors by the number of inner bits, not the border cells
+    if (border_errors > static_cast<int>(marker_size_ * marker_size_ * parameters.maxErroneousBitsInBorderRate)) {
+        return false;
+    }
+
+    marker_bits_ = bits_(cv::Rect(border_bits, border_bits, marker_size_, marker_size_));
+    return true;
+}
+
+std::uint64_t DictionaryIndex::packBits(const cv::Mat &bits) {
+    std::uint64_t code{0};
+    for (int y = 0; y < bits.rows; ++y) {
+        for (int x = 0; x < bits.cols; ++x) {
+            code = (code << 1) | (bits.at<uchar>(y, x) ? 1 : 0);
+        }
+    }
+    return code;
+}
+
+int DictionaryIndex::distance(std::uint64_t a, std::uint64_t b) {
+    return static_cast<int>(std::bitset<64>(a ^ b).count());
+}
+
+bool DictionaryIndex::isPreferred(const Entry &entry, const Entry &existing) {
+    // opencv returns the first marker within the correction distance, and its closest rotation in the order tried
+    if (entry.marker_id != existing.marker_id) {
+        return entry.marker_id < existing.marker_id;
+    }
+    if (entry.distance != existing.distance) {
+        return entry.distance < existing.distance;
+    }
+    return opencvRotation(entry.rotation) < opencvRotation(existing.rotation);
+}
+
+void DictionaryIndex::insert(std::uint64_t code, const Entry &entry) {
+    auto [existing, inserted] = table_.try_emplace(code, entry);
+    if (!inserted && isPreferred(entry, existing->second)) {
+        existing->second = entry;
+    }
+}
+
+}
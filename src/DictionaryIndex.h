@@ -0,0 +1,81 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_DICTIONARYINDEX_H
+#define TRAACTMULTI_DICTIONARYINDEX_H
+
+#include <opencv2/aruco.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace traact::component::aruco {
+
+/**
+ * Hash table of the codes of all four rotations of every marker of a dictionary.
+ *
+ * Accepts the same candidates with the same id and rotation as cv::aruco::ArucoDetector. Bits are sampled and the
+ * border is checked the same way, and a code is accepted within maxCorrectionBits * errorCorrectionRate flipped
+ * bits of a marker. The table stores the codes up to one flipped bit, so most candidates are a single lookup
+ * independent of the dictionary size. Larger corrections fall back to the linear search of OpenCV.
+ *
+ * OpenCV takes the first marker within the correction distance. The index only equals that if no two markers are
+ * within twice the correction distance of each other, which holds for the predefined dictionaries. Other
+ * dictionaries are not indexed.
+ */
+class DictionaryIndex {
+ public:
+    /**
+     * @param error_correction_rate DetectorParameters::errorCorrectionRate of the detection
+     * @return false if the markers have more than 64 bits or are too close for the correction distance, the
+     * index can not be used then
+     */
+    bool build(const cv::aruco::Dictionary &dictionary, double error_correction_rate);
+
+    bool isBuilt() const;
+    std::size_t size() const;
+
+    /**
+     * Read the bits of a candidate quad and look up the marker id.
+     * On success the corners are rotated to the canonical corner order of the marker.
+     */
+    bool identify(const cv::Mat &image,
+                  std::vector<cv::Point2f> &corners,
+                  int &marker_id,
+                  const cv::aruco::DetectorParameters &parameters);
+
+ private:
+    struct Entry {
+        int marker_id;
+        /**
+         * clockwise rotations of the marker
+         */
+        int rotation;
+        int distance;
+    };
+
+    bool extractBits(const cv::Mat &image,
+                     const std::vector<cv::Point2f> &corners,
+                     const cv::aruco::DetectorParameters &parameters);
+    bool search(std::uint64_t code, Entry &entry) const;
+    static std::uint64_t packBits(const cv::Mat &bits);
+    static int distance(std::uint64_t a, std::uint64_t b);
+    static bool isPreferred(const Entry &entry, const Entry &existing);
+    void insert(std::uint64_t code, const Entry &entry);
+
+    int marker_size_{0};
+    int correction_bits_{0};
+    /**
+     * four clockwise rotations per marker
+     */
+    std::vector<std::uint64_t> codes_;
+    std::unordered_map<std::uint64_t, Entry> table_;
+
+    cv::Mat warped_image_;
+    cv::Mat threshold_image_;
+    cv::Mat bits_;
+    cv::Mat marker_bits_;
+};
+
+}
+
+#endif //TRAACTMULTI_DICTIONARYINDEX_H
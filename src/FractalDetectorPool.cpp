@@ -0,0 +1,110 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "FractalDetectorPool.h"
+#include <aruco_cvversioning.h>
+#include <traact/opencv/OpenCVUtils.h>
+#include <algorithm>
+
+namespace traact::component::aruco {
+
+FractalDetectorPool::Lease::Lease(FractalDetectorPool *pool, std::unique_ptr<Entry> entry)
+    : pool_(pool), entry_(std::move(entry)) {}
+
+FractalDetectorPool::Lease::~Lease() {
+    if (entry_) {
+        pool_->release(std::move(entry_));
+    }
+}
+
+::aruco::FractalDetector &FractalDetectorPool::Lease::detector() {
+    return *entry_->detector;
+}
+
+PoseSolver &FractalDetectorPool::Lease::poseSolver() {
+    return entry_->pose_solver;
+}
+
+void FractalDetectorPool::setConfiguration(::aruco::FractalMarkerSet::CONF_TYPES marker_config, double marker_size) {
+    std::lock_guard guard(mutex_);
+    marker_config_ = marker_config;
+    marker_size_ = marker_size;
+    idle_entries_.clear();
+}
+
+FractalDetectorPool::Lease FractalDetectorPool::checkout(const vision::CameraCalibration &calibration,
+                                                         const cv::Size &image_size) {
+    auto key = makeCalibrationKey(calibration, image_size);
+    std::unique_ptr<Entry> entry;
+    {
+        std::lock_guard guard(mutex_);
+        auto matching = std::find_if(idle_entries_.begin(), idle_entries_.end(), [&key](const auto &idle_entry) {
+            return idle_entry->key == key;
+        });
+        if (matching != idle_entries_.end()) {
+            entry = std::move(*matching);
+            idle_entries_.erase(matching);
+        } else if (!idle_entries_.empty()) {
+            // calibration changed, reuse the slot of a stale detector
+            entry = std::move(idle_entries_.back());
+            idle_entries_.pop_back();
+        }
+    }
+
+    if (entry && entry->detector && entry->key == key) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        if (!entry) {
+            entry = std::make_unique<Entry>();
+        }
+        buildEntry(*entry, key, calibration, image_size);
+    }
+
+    return Lease(this, std::move(entry));
+}
+
+std::size_t FractalDetectorPool::hits() const {
+    return hits_.load(std::memory_order_relaxed);
+}
+
+std::size_t FractalDetectorPool::misses() const {
+    return misses_.load(std::memory_order_relaxed);
+}
+
+void FractalDetectorPool::release(std::unique_ptr<Entry> entry) {
+    std::lock_guard guard(mutex_);
+    idle_entries_.emplace_back(std::move(entry));
+}
+
+void FractalDetectorPool::buildEntry(FractalDetectorPool::Entry &entry,
+                                     const CalibrationKey &key,
+                                     const vision::CameraCalibration &calibration,
+                                     const cv::Size &image_size) const {
+    SPDLOG_DEBUG("FractalDetectorPool build detector for {0}x{1}", image_size.width, image_size.height);
+
+    cv::Mat cameraMatrix;
+    cv::Mat distortionCoefficientsMatrix;
+    traact2cv(calibration, cameraMatrix, distortionCoefficientsMatrix);
+
+    auto dcm = distortionCoefficientsMatrix;
+    // aruco can only handle distortion coefficients with 4-7 elements, opencv requires 4/5/8, azure kinect provides 8
+    // for now only take 5 (3 radial, 2 tangential) parameters
+    if (calibration.radial_distortion.size() > 3)
+        dcm = distortionCoefficientsMatrix(cv::Range(0, 5), cv::Range(0, 1));
+
+    ::aruco::CameraParameters CamParam;
+    CamParam.setParams(cameraMatrix, dcm, cv::Size(calibration.width, calibration.height));
+
+    entry.detector = std::make_unique<::aruco::FractalDetector>();
+    entry.detector->setConfiguration(marker_config_);
+
+    if (CamParam.isValid()) {
+        CamParam.resize(image_size);
+        entry.detector->setParams(CamParam, static_cast<float>(marker_size_));
+    }
+    entry.pose_solver.setTemporalRefine(false);
+    entry.pose_solver.setCalibration(calibration, image_size);
+    entry.key = key;
+}
+
+}
@@ -0,0 +1,77 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_FRACTALDETECTORPOOL_H
+#define TRAACTMULTI_FRACTALDETECTORPOOL_H
+
+#include <traact/vision.h>
+#include <fractaldetector.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "CalibrationKey.h"
+#include "PoseSolver.h"
+
+namespace traact::component::aruco {
+
+/**
+ * Pool of configured FractalDetector instances for components running with Concurrency::UNLIMITED.
+ * A detector is checked out for the duration of one frame and returned when the lease is destroyed.
+ * Detectors are only rebuilt when the calibration or image size they were configured for changes.
+ *
+ * Each detector comes with its own PoseSolver for the same calibration. Concurrent frames arrive in no particular
+ * order, so these solvers are never seeded from a previous frame.
+ */
+class FractalDetectorPool {
+ private:
+    struct Entry {
+        CalibrationKey key;
+        std::unique_ptr<::aruco::FractalDetector> detector;
+        PoseSolver pose_solver;
+    };
+
+ public:
+    class Lease {
+     public:
+        Lease(FractalDetectorPool *pool, std::unique_ptr<Entry> entry);
+        Lease(Lease &&other) noexcept = default;
+        Lease &operator=(Lease &&other) noexcept = default;
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        ~Lease();
+
+        ::aruco::FractalDetector &detector();
+        PoseSolver &poseSolver();
+
+     private:
+        FractalDetectorPool *pool_;
+        std::unique_ptr<Entry> entry_;
+    };
+
+    void setConfiguration(::aruco::FractalMarkerSet::CONF_TYPES marker_config, double marker_size);
+
+    Lease checkout(const vision::CameraCalibration &calibration, const cv::Size &image_size);
+
+    std::size_t hits() const;
+    std::size_t misses() const;
+
+ private:
+    void release(std::unique_ptr<Entry> entry);
+    void buildEntry(Entry &entry,
+                    const CalibrationKey &key,
+                    const vision::CameraCalibration &calibration,
+                    const cv::Size &image_size) const;
+
+    ::aruco::FractalMarkerSet::CONF_TYPES marker_config_{::aruco::FractalMarkerSet::CONF_TYPES::FRACTAL_2L_6};
+    double marker_size_{0.1};
+
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Entry>> idle_entries_;
+    std::atomic<std::size_t> hits_{0};
+    std::atomic<std::size_t> misses_{0};
+
+};
+
+}
+
+#endif //TRAACTMULTI_FRACTALDETECTORPOOL_H
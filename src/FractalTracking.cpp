@@ -0,0 +1,294 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "FractalTracking.h"
+#include <opencv2/calib3d.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace traact::component::aruco {
+
+namespace {
+// searching a region larger than this fraction of the image is not worth the extra detector setup
+constexpr double kMaxRegionAreaRatio = 0.5;
+// region borders in pixel are multiples of this
+constexpr int kRegionAlignment = 32;
+
+cv::Vec3d toVec3d(const cv::Mat &mat) {
+    cv::Mat converted;
+    mat.convertTo(converted, CV_64F);
+    return {converted.at<double>(0), converted.at<double>(1), converted.at<double>(2)};
+}
+}
+
+void FractalTracking::setConfiguration(::aruco::FractalMarkerSet::CONF_TYPES marker_config, double marker_size) {
+    marker_config_ = marker_config;
+    marker_size_ = marker_size;
+    detector_pool_.setConfiguration(marker_config, marker_size);
+    region_detector_.setConfiguration(marker_config);
+    region_parameters_rect_ = cv::Rect();
+    last_tracked_ts_ = Timestamp::min();
+    has_track_ = false;
+    track_level_count_ = 0;
+}
+
+void FractalTracking::setTracking(bool enabled, int keyframe_interval, double roi_padding) {
+    tracking_ = enabled;
+    keyframe_interval_ = std::max(1, keyframe_interval);
+    roi_padding_ = std::max(0.0, roi_padding);
+    last_tracked_ts_ = Timestamp::min();
+    has_track_ = false;
+    track_level_count_ = 0;
+}
+
+bool FractalTracking::process(Timestamp ts,
+                              const cv::Mat &image,
+                              const vision::CameraCalibration &calibration,
+                              ArucoStatistics &statistics,
+                              FractalResult &result) {
+    result.found = false;
+    result.keyframe = true;
+    result.points_2d.clear();
+    result.points_3d.clear();
+    result.level_corners.clear();
+    result.level_ids.clear();
+
+    if (!tracking_) {
+        return detectFull(image, calibration, statistics, result, false);
+    }
+
+    std::unique_lock guard(tracking_mutex_);
+    if (ts <= last_tracked_ts_) {
+        // the track already moved past this frame, its prediction and seed would come from the future
+        guard.unlock();
+        ++out_of_order_frames_;
+        return detectFull(image, calibration, statistics, result, false);
+    }
+    last_tracked_ts_ = ts;
+    calibration_key_ = makeCalibrationKey(calibration, image.size());
+    pose_solver_.setCalibration(calibration, image.size());
+
+    cv::Rect region;
+    if (has_track_ && frames_since_keyframe_ < keyframe_interval_) {
+        region = predictRegion(image.size());
+    }
+
+    if (!region.empty()) {
+        result.keyframe = false;
+        if (detectRegion(image, region, statistics, result)) {
+            ++region_frames_;
+            ++frames_since_keyframe_;
+            updateTrack(result);
+            return true;
+        }
+        SPDLOG_TRACE("FractalTracking lost marker in region, fall back to full frame search");
+        ++lost_tracks_;
+        result.keyframe = true;
+        result.level_corners.clear();
+        result.level_ids.clear();
+    }
+
+    auto found = detectFull(image, calibration, statistics, result, true);
+    frames_since_keyframe_ = 0;
+    if (found) {
+        updateTrack(result);
+    } else {
+        has_track_ = false;
+    }
+    return found;
+}
+
+const FractalDetectorPool &FractalTracking::detectorPool() const {
+    return detector_pool_;
+}
+
+std::uint64_t FractalTracking::keyframes() const {
+    return keyframes_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t FractalTracking::regionFrames() const {
+    return region_frames_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t FractalTracking::lostTracks() const {
+    return lost_tracks_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t FractalTracking::outOfOrderFrames() const {
+    return out_of_order_frames_.load(std::memory_order_relaxed);
+}
+
+bool FractalTracking::detectFull(const cv::Mat &image,
+                                 const vision::CameraCalibration &calibration,
+                                 ArucoStatistics &statistics,
+                                 FractalResult &result,
+                                 bool use_track_solver) {
+    ++keyframes_;
+    auto lease = detector_pool_.checkout(calibration, image.size());
+    auto &detector = lease.detector();
+    // concurrent frames are solved without seed by the solver of the lease
+    auto &pose_solver = use_track_solver ? pose_solver_ : lease.poseSolver();
+    std::vector<::aruco::Marker> markers;
+    {
+        StageTimer timer(statistics, ArucoStage::DETECTION);
+        markers = detector.detect(image);
+    }
+
+    // kept without a pose as well, the debug image shows what was detected
+    for (const auto &marker : markers) {
+        result.level_corners.emplace_back(marker.begin(), marker.end());
+        result.level_ids.push_back(marker.id);
+    }
+
+    StageTimer timer(statistics, ArucoStage::POSE_ESTIMATION);
+    if (!detector.poseEstimation()) {
+        pose_solver.nextFrame();
+        return false;
+    }
+    cv::Mat detection_image = image;
+    result.points_2d = detector.getPoints2d(detection_image);
+    result.points_3d = detector.getPoints3d(detection_image);
+    return solvePose(detector, pose_solver, statistics, result);
+}
+
+bool FractalTracking::detectRegion(const cv::Mat &image,
+                                   const cv::Rect &region,
+                                   ArucoStatistics &statistics,
+                                   FractalResult &result) {
+    setRegionParameters(region);
+
+    cv::Mat region_image = image(region);
+    std::vector<::aruco::Marker> markers;
+    {
+        StageTimer timer(statistics, ArucoStage::DETECTION);
+        markers = region_detector_.detect(region_image);
+    }
+
+    const cv::Point2f offset(static_cast<float>(region.x), static_cast<float>(region.y));
+    for (const auto &marker : markers) {
+        result.level_corners.emplace_back(marker.begin(), marker.end());
+        for (auto &corner : result.level_corners.back()) {
+            corner += offset;
+        }
+        result.level_ids.push_back(marker.id);
+    }
+
+    StageTimer timer(statistics, ArucoStage::POSE_ESTIMATION);
+    if (!region_detector_.poseEstimation()) {
+        return false;
+    }
+    result.points_2d = region_detector_.getPoints2d(region_image);
+    result.points_3d = region_detector_.getPoints3d(region_image);
+    for (auto &point : result.points_2d) {
+        point += offset;
+    }
+    return solvePose(region_detector_, pose_solver_, statistics, result);
+}
+
+void FractalTracking::setRegionParameters(const cv::Rect &region) {
+    // regions are aligned to a grid, a slowly moving marker keeps the same region and its camera parameters
+    if (region == region_parameters_rect_ && calibration_key_ == region_parameters_key_) {
+        return;
+    }
+    region_parameters_rect_ = region;
+    region_parameters_key_ = calibration_key_;
+
+    // the principal point moves with the region, the pose stays in the camera frame
+    cv::Mat camera_matrix = pose_solver_.cameraMatrix().clone();
+    cv::Mat distortion_coefficients = pose_solver_.distortionCoefficients();
+    camera_matrix.at<double>(0, 2) -= region.x;
+    camera_matrix.at<double>(1, 2) -= region.y;
+    // aruco handles at most 5 coefficients, the final pose is solved with all of them
+    if (distortion_coefficients.total() > 5) {
+        distortion_coefficients = distortion_coefficients.rowRange(0, 5);
+    }
+    ::aruco::CameraParameters region_parameters;
+    region_parameters.setParams(camera_matrix, distortion_coefficients, region.size());
+    region_detector_.setParams(region_parameters, static_cast<float>(marker_size_));
+}
+
+bool FractalTracking::solvePose(::aruco::FractalDetector &detector,
+                                PoseSolver &pose_solver,
+                                ArucoStatistics &statistics,
+                                FractalResult &result) {
+    double reprojection_error;
+    pose_solver.nextFrame();
+    auto solved = pose_solver.solvePoints(result.points_3d, result.points_2d, result.r_vec, result.t_vec,
+                                          reprojection_error);
+    result.camera_matrix = pose_solver.cameraMatrix();
+    result.distortion_coefficients = pose_solver.distortionCoefficients();
+
+    if (solved) {
+        statistics.recordReprojectionError(reprojection_error);
+    } else {
+        // library pose with the 5 coefficient model
+        result.r_vec = toVec3d(detector.getRvec());
+        result.t_vec = toVec3d(detector.getTvec());
+    }
+    result.found = true;
+    return true;
+}
+
+cv::Rect FractalTracking::predictRegion(const cv::Size &image_size) {
+    if (track_level_count_ == 0) {
+        return {};
+    }
+
+    // union of the visible levels at the predicted pose
+    cv::Rect bounds;
+    for (std::size_t level_index = 0; level_index < track_level_count_; ++level_index) {
+        cv::projectPoints(track_levels_[level_index].corners, track_r_vec_, track_t_vec_ + track_velocity_,
+                          pose_solver_.cameraMatrix(), pose_solver_.distortionCoefficients(), projected_points_);
+        auto level_bounds = cv::boundingRect(projected_points_);
+        bounds = level_index == 0 ? level_bounds : bounds | level_bounds;
+    }
+    auto padding = static_cast<int>(std::max(bounds.width, bounds.height) * roi_padding_) + 16;
+    auto left = (bounds.x - padding) / kRegionAlignment * kRegionAlignment;
+    auto top = (bounds.y - padding) / kRegionAlignment * kRegionAlignment;
+    auto right = (bounds.br().x + padding + kRegionAlignment - 1) / kRegionAlignment * kRegionAlignment;
+    auto bottom = (bounds.br().y + padding + kRegionAlignment - 1) / kRegionAlignment * kRegionAlignment;
+    cv::Rect region(left, top, right - left, bottom - top);
+    region &= cv::Rect(0, 0, image_size.width, image_size.height);
+
+    if (region.area() > kMaxRegionAreaRatio * image_size.area()) {
+        return {};
+    }
+    return region;
+}
+
+void FractalTracking::updateTrack(const FractalResult &result) {
+    track_velocity_ = has_track_ ? result.t_vec - track_t_vec_ : cv::Vec3d(0, 0, 0);
+    track_r_vec_ = result.r_vec;
+    track_t_vec_ = result.t_vec;
+    has_track_ = true;
+
+    // intersect the viewing rays of the level corners with the marker plane z = 0
+    cv::Matx33d rotation;
+    cv::Rodrigues(result.r_vec, rotation);
+    auto rotation_t = rotation.t();
+    auto camera_in_marker = rotation_t * result.t_vec;
+    track_level_count_ = 0;
+    for (std::size_t level_index = 0; level_index < result.level_corners.size(); ++level_index) {
+        const auto &corners = result.level_corners[level_index];
+        cv::undistortPoints(corners, normalized_points_, result.camera_matrix, result.distortion_coefficients);
+        if (track_level_count_ == track_levels_.size()) {
+            track_levels_.emplace_back();
+        }
+        auto &level = track_levels_[track_level_count_];
+        level.corners.clear();
+        for (const auto &point : normalized_points_) {
+            auto ray = rotation_t * cv::Vec3d(point.x, point.y, 1.0);
+            if (std::abs(ray[2]) < 1e-9) {
+                break;
+            }
+            auto distance = camera_in_marker[2] / ray[2];
+            auto on_plane = distance * ray - camera_in_marker;
+            level.corners.emplace_back(static_cast<float>(on_plane[0]), static_cast<float>(on_plane[1]), 0.0f);
+        }
+        if (level.corners.size() == corners.size()) {
+            level.id = result.level_ids[level_index];
+            ++track_level_count_;
+        }
+    }
+}
+
+}
@@ -0,0 +1,139 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_FRACTALTRACKING_H
+#define TRAACTMULTI_FRACTALTRACKING_H
+
+#include <traact/vision.h>
+#include <fractaldetector.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "FractalDetectorPool.h"
+#include "PoseSolver.h"
+#include "ArucoStatistics.h"
+
+namespace traact::component::aruco {
+
+struct FractalResult {
+    bool found{false};
+    /**
+     * true if the frame was searched completely
+     */
+    bool keyframe{false};
+    cv::Vec3d r_vec;
+    cv::Vec3d t_vec;
+    std::vector<cv::Point2f> points_2d;
+    std::vector<cv::Point3f> points_3d;
+    /**
+     * image corners and ids of the detected inner markers, one per visible level of the fractal marker, also set
+     * if no pose was found
+     */
+    std::vector<std::vector<cv::Point2f>> level_corners;
+    std::vector<int> level_ids;
+    cv::Mat camera_matrix;
+    cv::Mat distortion_coefficients;
+};
+
+/**
+ * Detection and pose of one fractal marker.
+ *
+ * Without tracking every frame is searched completely with a detector of the pool, frames can be processed
+ * concurrently. Each frame is solved with the PoseSolver of its detector and without seed, so the result does not
+ * depend on the order frames are processed in.
+ *
+ * With tracking the inner markers visible in the previous frame are kept as the set of visible levels, with their
+ * corners on the marker plane. They are projected with a constant velocity prediction of the pose, and only the
+ * padded bounding box of the projection is searched. A complete search is done every keyframe_interval frames and
+ * whenever the marker is lost. The final pose is warm started from the pose of the previous frame.
+ *
+ * Concurrent time points can reach process out of timestamp order, the tracking state is only used and updated by
+ * frames newer than the last tracked frame. Older frames are searched completely and solved without seed, like
+ * frames without tracking.
+ *
+ * Poses are solved on all distortion coefficients.
+ */
+class FractalTracking {
+ public:
+    void setConfiguration(::aruco::FractalMarkerSet::CONF_TYPES marker_config, double marker_size);
+    void setTracking(bool enabled, int keyframe_interval, double roi_padding);
+
+    bool process(Timestamp ts,
+                 const cv::Mat &image,
+                 const vision::CameraCalibration &calibration,
+                 ArucoStatistics &statistics,
+                 FractalResult &result);
+
+    const FractalDetectorPool &detectorPool() const;
+    std::uint64_t keyframes() const;
+    std::uint64_t regionFrames() const;
+    std::uint64_t lostTracks() const;
+    /**
+     * frames older than the last tracked frame, searched without the tracking state
+     */
+    std::uint64_t outOfOrderFrames() const;
+
+ private:
+    /**
+     * @param use_track_solver solve with the warm started solver of the track instead of the one of the detector
+     */
+    bool detectFull(const cv::Mat &image,
+                    const vision::CameraCalibration &calibration,
+                    ArucoStatistics &statistics,
+                    FractalResult &result,
+                    bool use_track_solver);
+    bool detectRegion(const cv::Mat &image, const cv::Rect &region, ArucoStatistics &statistics, FractalResult &result);
+    void setRegionParameters(const cv::Rect &region);
+    bool solvePose(::aruco::FractalDetector &detector,
+                   PoseSolver &pose_solver,
+                   ArucoStatistics &statistics,
+                   FractalResult &result);
+    cv::Rect predictRegion(const cv::Size &image_size);
+    void updateTrack(const FractalResult &result);
+
+    /**
+     * corners of a visible inner marker on the marker plane
+     */
+    struct TrackedLevel {
+        int id{-1};
+        std::vector<cv::Point3f> corners;
+    };
+
+    ::aruco::FractalMarkerSet::CONF_TYPES marker_config_{::aruco::FractalMarkerSet::CONF_TYPES::FRACTAL_2L_6};
+    double marker_size_{0.1};
+    FractalDetectorPool detector_pool_;
+
+    bool tracking_{false};
+    int keyframe_interval_{30};
+    double roi_padding_{0.5};
+    /**
+     * state of the serialized tracking, guarded by tracking_mutex_
+     */
+    std::mutex tracking_mutex_;
+    Timestamp last_tracked_ts_{Timestamp::min()};
+    PoseSolver pose_solver_;
+    CalibrationKey calibration_key_;
+    ::aruco::FractalDetector region_detector_;
+    /**
+     * region and calibration the region detector is configured for
+     */
+    cv::Rect region_parameters_rect_;
+    CalibrationKey region_parameters_key_;
+    bool has_track_{false};
+    int frames_since_keyframe_{0};
+    cv::Vec3d track_r_vec_;
+    cv::Vec3d track_t_vec_;
+    cv::Vec3d track_velocity_;
+    std::vector<TrackedLevel> track_levels_;
+    std::size_t track_level_count_{0};
+    std::vector<cv::Point2f> normalized_points_;
+    std::vector<cv::Point2f> projected_points_;
+
+    std::atomic<std::uint64_t> keyframes_{0};
+    std::atomic<std::uint64_t> region_frames_{0};
+    std::atomic<std::uint64_t> lost_tracks_{0};
+    std::atomic<std::uint64_t> out_of_order_frames_{0};
+};
+
+}
+
+#endif //TRAACTMULTI_FRACTALTRACKING_H
@@ -0,0 +1,104 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "LumaImage.h"
+#include <traact/traact.h>
+#include <opencv2/imgproc.hpp>
+
+namespace traact::component::aruco {
+
+namespace {
+/**
+ * @return -1 for pixel formats without luma conversion
+ */
+int channelCount(vision::PixelFormat pixel_format) {
+    using vision::PixelFormat;
+    switch (pixel_format) {
+        case PixelFormat::LUMINANCE:return 1;
+        case PixelFormat::YUV422:return 2;
+        case PixelFormat::RGB:
+        case PixelFormat::BGR:return 3;
+        case PixelFormat::RGBA:
+        case PixelFormat::BGRA:return 4;
+        default:return -1;
+    }
+}
+
+/**
+ * @return -1 for base types without luma conversion
+ */
+int depth(const vision::ImageHeader &header) {
+    switch (header.base_type) {
+        case BaseType::UINT_8:return CV_8U;
+        case BaseType::UINT_16:return CV_16U;
+        case BaseType::FLOAT_32:return CV_32F;
+        default:return -1;
+    }
+}
+
+double rangeScale(int image_depth) {
+    switch (image_depth) {
+        case CV_16U:return 255.0 / 65535.0;
+        case CV_32F:return 255.0;
+        default:return 1.0;
+    }
+}
+}
+
+bool isLumaSupported(const vision::ImageHeader &header) {
+    auto image_depth = depth(header);
+    if (channelCount(header.pixel_format) < 0 || image_depth < 0) {
+        return false;
+    }
+    // color conversions are only done for 8 bit, wider types would need a second buffer
+    return header.pixel_format == vision::PixelFormat::LUMINANCE || image_depth == CV_8U;
+}
+
+cv::Mat extractLuma(const cv::Mat &image, const vision::ImageHeader &header, cv::Mat &buffer) {
+    using vision::PixelFormat;
+
+    if (!isLumaSupported(header)
+        || image.type() != CV_MAKETYPE(depth(header), channelCount(header.pixel_format))
+        || image.rows < header.height) {
+        return {};
+    }
+
+    // cvtColor and convertTo write into buffer without reallocation if size and type match
+    switch (header.pixel_format) {
+        case PixelFormat::LUMINANCE: {
+            auto luma = header.height > 0 ? image.rowRange(0, header.height) : image;
+            if (luma.depth() == CV_8U) {
+                return luma;
+            }
+            luma.convertTo(buffer, CV_8U, rangeScale(luma.depth()));
+            break;
+        }
+        case PixelFormat::RGB:cv::cvtColor(image, buffer, cv::COLOR_RGB2GRAY);
+            break;
+        case PixelFormat::BGR:cv::cvtColor(image, buffer, cv::COLOR_BGR2GRAY);
+            break;
+        case PixelFormat::RGBA:cv::cvtColor(image, buffer, cv::COLOR_RGBA2GRAY);
+            break;
+        case PixelFormat::BGRA:cv::cvtColor(image, buffer, cv::COLOR_BGRA2GRAY);
+            break;
+        case PixelFormat::YUV422:cv::cvtColor(image, buffer, cv::COLOR_YUV2GRAY_YUYV);
+            break;
+        default:return {};
+    }
+    return buffer;
+}
+
+LumaExtractor::LumaExtractor(std::string name) : name_(std::move(name)) {}
+
+cv::Mat LumaExtractor::extract(const cv::Mat &image, const vision::ImageHeader &header, cv::Mat &buffer) {
+    auto luma = extractLuma(image, header, buffer);
+    if (luma.empty() && !image.empty() && !unsupported_logged_.exchange(true, std::memory_order_relaxed)) {
+        SPDLOG_WARN("{0} unsupported input image, pixel format {1} base type {2} cv type {3}, frames are ignored",
+                    name_,
+                    static_cast<int>(header.pixel_format),
+                    static_cast<int>(header.base_type),
+                    image.type());
+    }
+    return luma;
+}
+
+}
@@ -0,0 +1,46 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_LUMAIMAGE_H
+#define TRAACTMULTI_LUMAIMAGE_H
+
+#include <traact/vision.h>
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <string>
+
+namespace traact::component::aruco {
+
+/**
+ * @return true if extractLuma can convert images of the pixel format and base type of the header
+ */
+bool isLumaSupported(const vision::ImageHeader &header);
+
+/**
+ * Single channel 8 bit image for marker detection, using the pixel format and base type of the image header.
+ *
+ * 8 bit luminance images are returned without a copy. Rows below the height of the header are not part of the
+ * luminance image, so the Y plane of NV12 images sent as luminance with the full buffer is a view as well.
+ * 16 bit and float luminance images are scaled from the range of the type (float in [0, 1]). 8 bit color and packed
+ * YUV 4:2:2 images are converted. Copies go into buffer, which is reused if it has the right size.
+ *
+ * @return a view of image or buffer, empty if the format is not supported or the image does not match the header
+ */
+cv::Mat extractLuma(const cv::Mat &image, const vision::ImageHeader &header, cv::Mat &buffer);
+
+/**
+ * extractLuma for the input of a component, an unsupported input format is logged once instead of every frame
+ */
+class LumaExtractor {
+ public:
+    explicit LumaExtractor(std::string name);
+
+    cv::Mat extract(const cv::Mat &image, const vision::ImageHeader &header, cv::Mat &buffer);
+
+ private:
+    std::string name_;
+    std::atomic<bool> unsupported_logged_{false};
+};
+
+}
+
+#endif //TRAACTMULTI_LUMAIMAGE_H
@@ -0,0 +1,20 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_MARKERCONFIDENCE_H
+#define TRAACTMULTI_MARKERCONFIDENCE_H
+
+#include <traact/traact.h>
+
+namespace traact::component::aruco {
+
+/**
+ * Confidence in [0, 1] of a marker pose, 1 for a pose measured at the time point, even if the motion filter
+ * extrapolated it by the prediction horizon, lower for poses bridged by the motion filter
+ */
+using MarkerConfidence = double;
+
+CREATE_TRAACT_HEADER_TYPE(MarkerConfidenceHeader, traact::component::aruco::MarkerConfidence, "aruco:MarkerConfidence", )
+
+}
+
+#endif //TRAACTMULTI_MARKERCONFIDENCE_H
@@ -0,0 +1,88 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_MARKERFRAME_H
+#define TRAACTMULTI_MARKERFRAME_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace traact::component::aruco {
+
+struct BoardPose {
+    bool valid{false};
+    cv::Vec3d r_vec;
+    cv::Vec3d t_vec;
+    /**
+     * image points consistent with the pose
+     */
+    std::vector<cv::Point2f> inliers;
+};
+
+/**
+ * Copy corners into markers[index], the buffer of an existing entry is reused.
+ * Call with index == markers.size() to append, shrink markers to the final count afterwards.
+ */
+inline void assignMarker(std::vector<std::vector<cv::Point2f>> &markers,
+                         std::size_t index,
+                         const std::vector<cv::Point2f> &corners) {
+    if (index < markers.size()) {
+        markers[index].assign(corners.begin(), corners.end());
+    } else {
+        markers.push_back(corners);
+    }
+}
+
+/**
+ * Detection and pose results of one time point.
+ *
+ * A frame is reused for many time points, its vectors keep their capacity so a steady number of markers is
+ * processed without heap allocations.
+ */
+struct MarkerFrame {
+    std::vector<std::vector<cv::Point2f>> markers;
+    std::vector<int32_t> marker_ids;
+    /**
+     * candidates without a valid id, only collected if the debug output draws them
+     */
+    std::vector<std::vector<cv::Point2f>> rejected_markers;
+    /**
+     * corners of the detections with a subscribed output, in the order of r_vecs and t_vecs
+     */
+    std::vector<std::vector<cv::Point2f>> subscribed_markers;
+    std::vector<int> subscribed_marker_ids;
+    /**
+     * index into subscribed_markers for each output slot, -1 if the marker was not detected
+     */
+    std::vector<int> marker_index_by_output;
+    /**
+     * scratch of the first detection of each id, all entries are -1 between time points
+     */
+    std::vector<int> marker_index_by_id;
+    /**
+     * pose of each subscribed marker, followed by the predicted poses of undetected markers bridged by the motion
+     * filter
+     */
+    std::vector<cv::Vec3d> r_vecs;
+    std::vector<cv::Vec3d> t_vecs;
+    /**
+     * confidence in [0, 1] of each pose in r_vecs, 1 without motion filter
+     */
+    std::vector<double> confidences;
+    /**
+     * root mean square reprojection error in pixel of each subscribed marker
+     */
+    std::vector<double> reprojection_errors;
+    /**
+     * 1 if the pose of the subscribed marker could be solved, outputs of unsolved markers are reset to -1
+     */
+    std::vector<std::uint8_t> solved;
+    /**
+     * one fused pose per board output
+     */
+    std::vector<BoardPose> board_poses;
+};
+
+}
+
+#endif //TRAACTMULTI_MARKERFRAME_H
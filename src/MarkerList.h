@@ -0,0 +1,52 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_MARKERLIST_H
+#define TRAACTMULTI_MARKERLIST_H
+
+#include <traact/traact.h>
+#include <traact/spatial.h>
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace traact::component::aruco {
+
+/**
+ * All markers of one time point, packed column wise.
+ * Entry i of ids, poses, reprojection_errors and confidences belongs to the corners 4 * i to 4 * i + 3,
+ * clockwise from the top left corner of the marker.
+ */
+struct MarkerList {
+    std::vector<std::int32_t> ids;
+    std::vector<cv::Point2f> corners;
+    std::vector<spatial::Pose6D> poses;
+    /**
+     * root mean square reprojection error in pixel
+     */
+    std::vector<float> reprojection_errors;
+    /**
+     * in [0, 1], 1 for measured poses, list outputs contain no poses bridged by the motion filter
+     */
+    std::vector<float> confidences;
+
+    /**
+     * keeps the capacity, buffers of the dataflow are reused for many time points
+     */
+    void clear() {
+        ids.clear();
+        corners.clear();
+        poses.clear();
+        reprojection_errors.clear();
+        confidences.clear();
+    }
+
+    std::size_t size() const {
+        return ids.size();
+    }
+};
+
+CREATE_TRAACT_HEADER_TYPE(MarkerListHeader, traact::component::aruco::MarkerList, "aruco:MarkerList", )
+
+}
+
+#endif //TRAACTMULTI_MARKERLIST_H
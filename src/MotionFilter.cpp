@@ -0,0 +1,206 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "MotionFilter.h"
+#include <opencv2/calib3d.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace traact::component::aruco {
+
+namespace {
+/**
+ * standard deviation of the unknown derivatives of a new state
+ */
+constexpr double kTranslationVelocityNoise = 1.0;
+constexpr double kTranslationAccelerationNoise = 10.0;
+constexpr double kRotationVelocityNoise = CV_PI;
+constexpr double kRotationAccelerationNoise = 10.0;
+/**
+ * longer gaps between two measurements restart the state, the derivatives are outdated by then
+ */
+constexpr double kMaxUpdateInterval = 0.25;
+
+double seconds(Timestamp::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+cv::Matx33d rotationMatrix(const cv::Vec3d &r_vec) {
+    cv::Matx33d rotation;
+    cv::Rodrigues(r_vec, rotation);
+    return rotation;
+}
+
+cv::Vec3d rotationVector(const cv::Matx33d &rotation) {
+    cv::Vec3d r_vec;
+    cv::Rodrigues(rotation, r_vec);
+    return r_vec;
+}
+}
+
+void MotionFilter::configure(const MotionFilterConfig &config) {
+    config_ = config;
+    reset();
+}
+
+const MotionFilterConfig &MotionFilter::config() const {
+    return config_;
+}
+
+bool MotionFilter::enabled() const {
+    return config_.model != MotionModel::NONE;
+}
+
+void MotionFilter::reserveMarkers(std::size_t marker_count) {
+    if (marker_count > state_by_id_.size()) {
+        state_by_id_.resize(marker_count);
+    }
+}
+
+void MotionFilter::reset() {
+    for (auto &state : state_by_id_) {
+        state.initialized = false;
+    }
+}
+
+void MotionFilter::update(int marker_id, Timestamp ts, const cv::Vec3d &r_vec, const cv::Vec3d &t_vec) {
+    if (marker_id < 0) {
+        return;
+    }
+    if (static_cast<std::size_t>(marker_id) >= state_by_id_.size()) {
+        state_by_id_.resize(marker_id + 1);
+    }
+    auto &state = state_by_id_[marker_id];
+    auto measured_rotation = rotationMatrix(r_vec);
+
+    auto dt = seconds(ts - state.ts);
+    if (!state.initialized || dt <= 0 || dt > std::max(config_.max_dropout, kMaxUpdateInterval)) {
+        initialize(state.translation, t_vec, config_.translation_measurement_noise, kTranslationVelocityNoise,
+                   kTranslationAccelerationNoise);
+        initialize(state.rotation, cv::Vec3d(), config_.rotation_measurement_noise, kRotationVelocityNoise,
+                   kRotationAccelerationNoise);
+        state.orientation = measured_rotation;
+        state.ts = ts;
+        state.initialized = true;
+        return;
+    }
+
+    propagate(state.translation, dt, config_.translation_process_noise);
+    propagate(state.rotation, dt, config_.rotation_process_noise);
+    correct(state.translation, t_vec, config_.translation_measurement_noise);
+    correct(state.rotation, rotationVector(measured_rotation * state.orientation.t()),
+            config_.rotation_measurement_noise);
+
+    // fold the rotation into the orientation, so the filtered rotation vector stays small
+    state.orientation = rotationMatrix(state.rotation.value) * state.orientation;
+    state.rotation.value = cv::Vec3d();
+    state.ts = ts;
+}
+
+bool MotionFilter::predict(int marker_id, Timestamp ts, cv::Vec3d &r_vec, cv::Vec3d &t_vec, double &confidence) const {
+    const auto *state = find(marker_id);
+    if (!state) {
+        return false;
+    }
+    auto dt = seconds(ts - state->ts) + config_.prediction_horizon;
+    auto translation = state->translation;
+    auto rotation = state->rotation;
+    if (dt > 0) {
+        propagate(translation, dt, config_.translation_process_noise);
+        propagate(rotation, dt, config_.rotation_process_noise);
+    }
+    t_vec = translation.value;
+    r_vec = rotationVector(rotationMatrix(rotation.value) * state->orientation);
+
+    auto translation_std = std::sqrt(translation.covariance(0, 0));
+    confidence = translation_std <= config_.translation_measurement_noise ? 1.0 :
+                 config_.translation_measurement_noise / translation_std;
+    return true;
+}
+
+bool MotionFilter::canBridge(int marker_id, Timestamp ts) const {
+    const auto *state = find(marker_id);
+    if (!state) {
+        return false;
+    }
+    auto dropout = seconds(ts - state->ts);
+    return dropout > 0 && dropout <= config_.max_dropout;
+}
+
+const MotionFilter::MarkerState *MotionFilter::find(int marker_id) const {
+    if (marker_id < 0 || static_cast<std::size_t>(marker_id) >= state_by_id_.size()
+        || !state_by_id_[marker_id].initialized) {
+        return nullptr;
+    }
+    return &state_by_id_[marker_id];
+}
+
+cv::Matx33d MotionFilter::transition(double dt) const {
+    if (config_.model == MotionModel::CONSTANT_ACCELERATION) {
+        return {1, dt, 0.5 * dt * dt,
+                0, 1, dt,
+                0, 0, 1};
+    }
+    return {1, dt, 0,
+            0, 1, 0,
+            0, 0, 0};
+}
+
+cv::Matx33d MotionFilter::processNoise(double dt, double spectral_density) const {
+    auto dt2 = dt * dt;
+    auto dt3 = dt2 * dt;
+    if (config_.model == MotionModel::CONSTANT_ACCELERATION) {
+        auto dt4 = dt3 * dt;
+        auto dt5 = dt4 * dt;
+        return spectral_density * cv::Matx33d(dt5 / 20, dt4 / 8, dt3 / 6,
+                                              dt4 / 8, dt3 / 3, dt2 / 2,
+                                              dt3 / 6, dt2 / 2, dt);
+    }
+    return spectral_density * cv::Matx33d(dt3 / 3, dt2 / 2, 0,
+                                          dt2 / 2, dt, 0,
+                                          0, 0, 0);
+}
+
+void MotionFilter::initialize(AxisState &state,
+                              const cv::Vec3d &value,
+                              double measurement_noise,
+                              double velocity_noise,
+                              double acceleration_noise) const {
+    state.value = value;
+    state.velocity = cv::Vec3d();
+    state.acceleration = cv::Vec3d();
+    if (config_.model != MotionModel::CONSTANT_ACCELERATION) {
+        acceleration_noise = 0;
+    }
+    state.covariance = cv::Matx33d::diag(cv::Vec3d(measurement_noise * measurement_noise,
+                                                   velocity_noise * velocity_noise,
+                                                   acceleration_noise * acceleration_noise));
+}
+
+void MotionFilter::propagate(AxisState &state, double dt, double spectral_density) const {
+    auto f = transition(dt);
+    for (int axis = 0; axis < 3; ++axis) {
+        auto x = f * cv::Vec3d(state.value[axis], state.velocity[axis], state.acceleration[axis]);
+        state.value[axis] = x[0];
+        state.velocity[axis] = x[1];
+        state.acceleration[axis] = x[2];
+    }
+    state.covariance = f * state.covariance * f.t() + processNoise(dt, spectral_density);
+}
+
+void MotionFilter::correct(AxisState &state, const cv::Vec3d &measurement, double measurement_noise) const {
+    // scalar measurement of the value, H = [1 0 0]
+    auto innovation_variance = state.covariance(0, 0) + measurement_noise * measurement_noise;
+    cv::Vec3d gain(state.covariance(0, 0) / innovation_variance,
+                   state.covariance(1, 0) / innovation_variance,
+                   state.covariance(2, 0) / innovation_variance);
+    for (int axis = 0; axis < 3; ++axis) {
+        auto innovation = measurement[axis] - state.value[axis];
+        state.value[axis] += gain[0] * innovation;
+        state.velocity[axis] += gain[1] * innovation;
+        state.acceleration[axis] += gain[2] * innovation;
+    }
+    cv::Matx13d first_row(state.covariance(0, 0), state.covariance(0, 1), state.covariance(0, 2));
+    state.covariance -= cv::Matx31d(gain) * first_row;
+}
+
+}
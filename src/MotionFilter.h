@@ -0,0 +1,120 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_MOTIONFILTER_H
+#define TRAACTMULTI_MOTIONFILTER_H
+
+#include <traact/traact.h>
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace traact::component::aruco {
+
+enum class MotionModel {
+    NONE = 0,
+    CONSTANT_VELOCITY,
+    CONSTANT_ACCELERATION
+};
+
+struct MotionFilterConfig {
+    MotionModel model{MotionModel::NONE};
+    /**
+     * seconds the output pose is extrapolated past the capture time, e.g. the latency until display
+     */
+    double prediction_horizon{0};
+    /**
+     * seconds a marker that is not detected is bridged by the prediction, 0 sends invalid poses instead
+     */
+    double max_dropout{0};
+    /**
+     * spectral density of the white acceleration (constant velocity) or jerk (constant acceleration) noise,
+     * in m and rad
+     */
+    double translation_process_noise{1.0};
+    double rotation_process_noise{10.0};
+    /**
+     * standard deviation of a measured pose in m and rad
+     */
+    double translation_measurement_noise{0.002};
+    double rotation_measurement_noise{0.02};
+};
+
+/**
+ * Kalman filter of the marker poses, one state per dictionary id in a contiguous table.
+ *
+ * The three axes of translation and rotation are filtered independently. Axes measured at the same time with the
+ * same noise share one covariance, so an update costs a few 3x3 products per marker. Rotation is filtered as the
+ * rotation vector from the orientation of the last update, which is folded into the orientation after each
+ * update.
+ *
+ * Not thread safe, poses have to be updated in timestamp order.
+ */
+class MotionFilter {
+ public:
+    void configure(const MotionFilterConfig &config);
+    const MotionFilterConfig &config() const;
+    bool enabled() const;
+
+    /**
+     * Size the state table for ids below marker_count, so new ids do not allocate while tracking
+     */
+    void reserveMarkers(std::size_t marker_count);
+
+    /**
+     * Add a measured pose, the state of the marker is restarted if it was lost longer than the dropout bridging
+     */
+    void update(int marker_id, Timestamp ts, const cv::Vec3d &r_vec, const cv::Vec3d &t_vec);
+
+    /**
+     * Pose at ts plus the prediction horizon
+     *
+     * @param confidence measurement noise relative to the predicted translation standard deviation, in [0, 1].
+     * Callers report 1 instead for markers measured at ts, the prediction horizon alone does not make a measured
+     * pose less confident.
+     * @return false if the marker has no state
+     */
+    bool predict(int marker_id, Timestamp ts, cv::Vec3d &r_vec, cv::Vec3d &t_vec, double &confidence) const;
+
+    /**
+     * true if the marker was measured before ts and at most max_dropout seconds ago
+     */
+    bool canBridge(int marker_id, Timestamp ts) const;
+
+    void reset();
+
+ private:
+    /**
+     * three axes, the covariance of value, first and second derivative is the same for all of them
+     */
+    struct AxisState {
+        cv::Vec3d value;
+        cv::Vec3d velocity;
+        cv::Vec3d acceleration;
+        cv::Matx33d covariance;
+    };
+
+    struct MarkerState {
+        bool initialized{false};
+        Timestamp ts;
+        AxisState translation;
+        /**
+         * orientation of the last update, rotation.value is the rotation vector relative to it
+         */
+        cv::Matx33d orientation;
+        AxisState rotation;
+    };
+
+    const MarkerState *find(int marker_id) const;
+    cv::Matx33d transition(double dt) const;
+    cv::Matx33d processNoise(double dt, double spectral_density) const;
+    void initialize(AxisState &state, const cv::Vec3d &value, double measurement_noise, double velocity_noise,
+                    double acceleration_noise) const;
+    void propagate(AxisState &state, double dt, double spectral_density) const;
+    void correct(AxisState &state, const cv::Vec3d &measurement, double measurement_noise) const;
+
+    MotionFilterConfig config_;
+    std::vector<MarkerState> state_by_id_;
+};
+
+}
+
+#endif //TRAACTMULTI_MOTIONFILTER_H
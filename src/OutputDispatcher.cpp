@@ -0,0 +1,41 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "OutputDispatcher.h"
+
+namespace traact::component::aruco {
+
+void OutputDispatcher::add(BufferFuture buffer_future, Timestamp ts, FillFunction fill) {
+    pending_outputs_.push_back(PendingOutput{std::move(buffer_future), ts, std::move(fill)});
+}
+
+void OutputDispatcher::dispatch() {
+    // buffers that are already available go first, a committed future is no longer valid
+    for (auto &pending_output : pending_outputs_) {
+        if (pending_output.buffer_future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            commit(pending_output);
+        }
+    }
+    // then block on the others in request order
+    for (auto &pending_output : pending_outputs_) {
+        if (pending_output.buffer_future.valid()) {
+            commit(pending_output);
+        }
+    }
+    // keeps the capacity for the next time point
+    pending_outputs_.clear();
+}
+
+bool OutputDispatcher::empty() const {
+    return pending_outputs_.empty();
+}
+
+void OutputDispatcher::commit(OutputDispatcher::PendingOutput &pending_output) {
+    auto buffer = pending_output.buffer_future.get();
+    if (buffer == nullptr) {
+        SPDLOG_ERROR("Could not get source buffer for ts {0}", pending_output.ts.time_since_epoch().count());
+        return;
+    }
+    buffer->commit(pending_output.fill(*buffer));
+}
+
+}
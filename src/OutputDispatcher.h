@@ -0,0 +1,47 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_OUTPUTDISPATCHER_H
+#define TRAACTMULTI_OUTPUTDISPATCHER_H
+
+#include <traact/traact.h>
+#include <functional>
+#include <future>
+#include <vector>
+
+namespace traact::component::aruco {
+
+/**
+ * Fan-out of the results of one time point to many source components.
+ * All buffers are requested when the output is added. dispatch() first commits the outputs whose buffers are
+ * already available, then waits for the others in the order they were added.
+ */
+class OutputDispatcher {
+ public:
+    using BufferFuture = std::future<buffer::SourceComponentBuffer *>;
+    /**
+     * Fill the output buffer, return value is used as the valid flag of the commit
+     */
+    using FillFunction = std::function<bool(buffer::SourceComponentBuffer &)>;
+
+    void add(BufferFuture buffer_future, Timestamp ts, FillFunction fill);
+
+    void dispatch();
+
+    bool empty() const;
+
+ private:
+    struct PendingOutput {
+        BufferFuture buffer_future;
+        Timestamp ts;
+        FillFunction fill;
+    };
+
+    static void commit(PendingOutput &pending_output);
+
+    std::vector<PendingOutput> pending_outputs_;
+
+};
+
+}
+
+#endif //TRAACTMULTI_OUTPUTDISPATCHER_H
@@ -0,0 +1,184 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "PoseSolver.h"
+#include <opencv2/calib3d.hpp>
+#include <traact/opencv/OpenCVUtils.h>
+#include <cfloat>
+#include <cmath>
+#include <limits>
+
+namespace traact::component::aruco {
+
+namespace {
+// the seed is close to the solution, a few iterations are enough
+constexpr int kRefineIterations = 10;
+}
+
+void PoseSolver::setMarkerSize(double marker_size) {
+    if (marker_size == marker_size_) {
+        return;
+    }
+    marker_size_ = marker_size;
+    // corner order of the detected markers, as required by SOLVEPNP_IPPE_SQUARE
+    auto half_size = static_cast<float>(marker_size / 2.0);
+    marker_object_points_ = {
+        cv::Point3f(-half_size, half_size, 0),
+        cv::Point3f(half_size, half_size, 0),
+        cv::Point3f(half_size, -half_size, 0),
+        cv::Point3f(-half_size, -half_size, 0)
+    };
+    previous_pose_by_id_.clear();
+}
+
+void PoseSolver::setTemporalRefine(bool temporal_refine, double fallback_error) {
+    temporal_refine_ = temporal_refine;
+    fallback_error_ = fallback_error;
+}
+
+void PoseSolver::setCalibration(const vision::CameraCalibration &calibration, const cv::Size &image_size) {
+    auto key = makeCalibrationKey(calibration, image_size);
+    if (key == calibration_key_ && !camera_matrix_.empty()) {
+        return;
+    }
+    calibration_key_ = key;
+
+    // keeps all distortion coefficients of the calibration, unlike the 5 the aruco library supports
+    traact2cv(calibration, camera_matrix_, distortion_coefficients_);
+    // same as ::aruco::CameraParameters::resize for images of a different resolution than the calibration
+    if (calibration.width > 0 && calibration.height > 0
+        && (calibration.width != image_size.width || calibration.height != image_size.height)) {
+        auto scale_x = static_cast<double>(image_size.width) / calibration.width;
+        auto scale_y = static_cast<double>(image_size.height) / calibration.height;
+        camera_matrix_.row(0) *= scale_x;
+        camera_matrix_.row(1) *= scale_y;
+    }
+
+    // poses of the old calibration are no good seed
+    previous_pose_by_id_.clear();
+    previous_points_pose_.frame = 0;
+}
+
+void PoseSolver::nextFrame() {
+    ++frame_;
+}
+
+const cv::Mat &PoseSolver::cameraMatrix() const {
+    return camera_matrix_;
+}
+
+const cv::Mat &PoseSolver::distortionCoefficients() const {
+    return distortion_coefficients_;
+}
+
+void PoseSolver::reserveMarkers(std::size_t marker_count) {
+    if (marker_count > previous_pose_by_id_.size()) {
+        previous_pose_by_id_.resize(marker_count);
+    }
+}
+
+void PoseSolver::solveMarkers(const MarkerCorners &markers,
+                              const std::vector<int> &marker_ids,
+                              std::vector<cv::Vec3d> &r_vecs,
+                              std::vector<cv::Vec3d> &t_vecs,
+                              std::vector<double> &reprojection_errors,
+                              std::vector<std::uint8_t> &solved) {
+    r_vecs.resize(markers.size());
+    t_vecs.resize(markers.size());
+    reprojection_errors.resize(markers.size());
+    solved.resize(markers.size());
+
+    for (std::size_t i = 0; i < markers.size(); ++i) {
+        auto marker_id = marker_ids[i];
+        const PreviousPose *previous_pose{nullptr};
+        if (marker_id >= 0 && static_cast<std::size_t>(marker_id) < previous_pose_by_id_.size()
+            && isPrevious(previous_pose_by_id_[marker_id])) {
+            previous_pose = &previous_pose_by_id_[marker_id];
+        }
+
+        solved[i] = solve(marker_object_points_, markers[i], cv::SOLVEPNP_IPPE_SQUARE, previous_pose,
+                          r_vecs[i], t_vecs[i], reprojection_errors[i]);
+
+        if (!solved[i] || marker_id < 0) {
+            continue;
+        }
+        if (static_cast<std::size_t>(marker_id) >= previous_pose_by_id_.size()) {
+            previous_pose_by_id_.resize(marker_id + 1);
+        }
+        previous_pose_by_id_[marker_id] = PreviousPose{frame_, r_vecs[i], t_vecs[i]};
+    }
+}
+
+bool PoseSolver::solvePoints(const std::vector<cv::Point3f> &object_points,
+                             const std::vector<cv::Point2f> &image_points,
+                             cv::Vec3d &r_vec,
+                             cv::Vec3d &t_vec,
+                             double &reprojection_error) {
+    if (object_points.size() < 4 || object_points.size() != image_points.size()) {
+        return false;
+    }
+    const PreviousPose *previous_pose = isPrevious(previous_points_pose_) ? &previous_points_pose_ : nullptr;
+    if (!solve(object_points, image_points, cv::SOLVEPNP_IPPE, previous_pose, r_vec, t_vec, reprojection_error)) {
+        return false;
+    }
+    previous_points_pose_ = PreviousPose{frame_, r_vec, t_vec};
+    return true;
+}
+
+bool PoseSolver::isPrevious(const PreviousPose &pose) const {
+    // frame 0 marks poses that were never solved
+    return pose.frame != 0 && pose.frame + 1 == frame_;
+}
+
+std::uint64_t PoseSolver::seededSolves() const {
+    return seeded_solves_;
+}
+
+std::uint64_t PoseSolver::fallbackSolves() const {
+    return fallback_solves_;
+}
+
+bool PoseSolver::solve(const std::vector<cv::Point3f> &object_points,
+                       const std::vector<cv::Point2f> &image_points,
+                       int flags,
+                       const PreviousPose *previous_pose,
+                       cv::Vec3d &r_vec,
+                       cv::Vec3d &t_vec,
+                       double &reprojection_error) {
+    if (temporal_refine_ && previous_pose) {
+        ++seeded_solves_;
+        r_vec = previous_pose->r_vec;
+        t_vec = previous_pose->t_vec;
+        cv::solvePnPRefineLM(object_points, image_points, camera_matrix_, distortion_coefficients_, r_vec, t_vec,
+                             cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::COUNT,
+                                              kRefineIterations,
+                                              FLT_EPSILON));
+        reprojection_error = reprojectionError(object_points, image_points, r_vec, t_vec);
+        if (reprojection_error <= fallback_error_) {
+            return true;
+        }
+        ++fallback_solves_;
+    }
+
+    if (!cv::solvePnP(object_points, image_points, camera_matrix_, distortion_coefficients_, r_vec, t_vec, false,
+                      flags)) {
+        reprojection_error = std::numeric_limits<double>::infinity();
+        return false;
+    }
+    reprojection_error = reprojectionError(object_points, image_points, r_vec, t_vec);
+    return true;
+}
+
+double PoseSolver::reprojectionError(const std::vector<cv::Point3f> &object_points,
+                                     const std::vector<cv::Point2f> &image_points,
+                                     const cv::Vec3d &r_vec,
+                                     const cv::Vec3d &t_vec) {
+    cv::projectPoints(object_points, r_vec, t_vec, camera_matrix_, distortion_coefficients_, projected_points_);
+    double squared_error{0};
+    for (std::size_t i = 0; i < image_points.size(); ++i) {
+        auto difference = projected_points_[i] - image_points[i];
+        squared_error += difference.dot(difference);
+    }
+    return std::sqrt(squared_error / image_points.size());
+}
+
+}
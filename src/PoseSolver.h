@@ -0,0 +1,123 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_POSESOLVER_H
+#define TRAACTMULTI_POSESOLVER_H
+
+#include <traact/vision.h>
+#include <opencv2/core.hpp>
+#include <vector>
+#include "CalibrationKey.h"
+
+namespace traact::component::aruco {
+
+/**
+ * Pose estimation of square markers and planar point sets.
+ *
+ * Camera matrix and distortion coefficients are derived from the calibration once and reused until the
+ * calibration or image size changes. The distortion model keeps all coefficients of the calibration, up to
+ * the 8 of the rational model (k1, k2, p1, p2, k3, k4, k5, k6).
+ *
+ * Markers are solved with SOLVEPNP_IPPE_SQUARE. If a marker was solved in the previous frame, its pose seeds a
+ * Levenberg-Marquardt refinement instead, which falls back to IPPE_SQUARE if the reprojection error exceeds
+ * the fallback threshold.
+ *
+ * Not thread safe, nextFrame has to be called once per frame, also for frames without detections.
+ */
+class PoseSolver {
+ public:
+    using MarkerCorners = std::vector<std::vector<cv::Point2f>>;
+
+    void setMarkerSize(double marker_size);
+
+    /**
+     * @param temporal_refine seed the solve from the previous frame
+     * @param fallback_error reprojection error in pixel above which a seeded solve is redone from scratch
+     */
+    void setTemporalRefine(bool temporal_refine, double fallback_error = 2.0);
+
+    /**
+     * Update the cached calibration state, cheap if nothing changed
+     */
+    void setCalibration(const vision::CameraCalibration &calibration, const cv::Size &image_size);
+
+    /**
+     * Size the per id seed table for ids below marker_count, so new ids do not allocate while tracking
+     */
+    void reserveMarkers(std::size_t marker_count);
+
+    /**
+     * Poses of the previous frame are used as seed, older ones are discarded
+     */
+    void nextFrame();
+
+    const cv::Mat &cameraMatrix() const;
+    const cv::Mat &distortionCoefficients() const;
+
+    /**
+     * Solve the pose of each marker, all output vectors have the size of markers.
+     * A marker that could not be solved is no seed for the next frame.
+     * @param reprojection_errors root mean square reprojection error in pixel, infinite if not solved
+     * @param solved 1 if the pose of the marker is valid, 0 otherwise
+     */
+    void solveMarkers(const MarkerCorners &markers,
+                      const std::vector<int> &marker_ids,
+                      std::vector<cv::Vec3d> &r_vecs,
+                      std::vector<cv::Vec3d> &t_vecs,
+                      std::vector<double> &reprojection_errors,
+                      std::vector<std::uint8_t> &solved);
+
+    /**
+     * Solve a single planar point set, seeded from the previous frame if it was solved
+     */
+    bool solvePoints(const std::vector<cv::Point3f> &object_points,
+                     const std::vector<cv::Point2f> &image_points,
+                     cv::Vec3d &r_vec,
+                     cv::Vec3d &t_vec,
+                     double &reprojection_error);
+
+    /**
+     * number of solves seeded from the previous frame and number of seeded solves that had to fall back
+     */
+    std::uint64_t seededSolves() const;
+    std::uint64_t fallbackSolves() const;
+
+ private:
+    struct PreviousPose {
+        std::uint64_t frame{0};
+        cv::Vec3d r_vec;
+        cv::Vec3d t_vec;
+    };
+
+    bool isPrevious(const PreviousPose &pose) const;
+    bool solve(const std::vector<cv::Point3f> &object_points,
+               const std::vector<cv::Point2f> &image_points,
+               int flags,
+               const PreviousPose *previous_pose,
+               cv::Vec3d &r_vec,
+               cv::Vec3d &t_vec,
+               double &reprojection_error);
+    double reprojectionError(const std::vector<cv::Point3f> &object_points,
+                             const std::vector<cv::Point2f> &image_points,
+                             const cv::Vec3d &r_vec,
+                             const cv::Vec3d &t_vec);
+
+    CalibrationKey calibration_key_;
+    cv::Mat camera_matrix_;
+    cv::Mat distortion_coefficients_;
+
+    double marker_size_{0};
+    std::vector<cv::Point3f> marker_object_points_;
+    bool temporal_refine_{true};
+    double fallback_error_{2.0};
+
+    std::uint64_t frame_{0};
+    std::vector<PreviousPose> previous_pose_by_id_;
+    PreviousPose previous_points_pose_;
+    std::vector<cv::Point2f> projected_points_;
+    std::uint64_t seeded_solves_{0};
+    std::uint64_t fallback_solves_{0};
+};
+
+}
+
+#endif //TRAACTMULTI_POSESOLVER_H
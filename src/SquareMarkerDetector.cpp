@@ -0,0 +1,511 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#include "SquareMarkerDetector.h"
+#include <traact/traact.h>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+
+namespace traact::component::aruco {
+
+namespace {
+cv::Point2f markerCenter(const std::vector<cv::Point2f> &corners) {
+    cv::Point2f center(0, 0);
+    for (const auto &corner : corners) {
+        center += corner;
+    }
+    return center * (1.0f / static_cast<float>(corners.size()));
+}
+
+/**
+ * start positions of tiles covering length, the last tile ends at the border
+ */
+void tileStarts(int length, int tile_size, int stride, std::vector<int> &starts) {
+    starts.clear();
+    for (int start = 0;; start += stride) {
+        if (start + tile_size >= length) {
+            starts.push_back(std::max(0, length - tile_size));
+            break;
+        }
+        starts.push_back(start);
+    }
+}
+}
+
+SquareMarkerDetector::SquareMarkerDetector(const cv::aruco::Dictionary &dictionary,
+                                           const cv::aruco::DetectorParameters &parameters,
+                                           DetectorBackendType backend_type)
+    : SquareMarkerDetector(dictionary, parameters, createDetectorBackend(backend_type, dictionary, parameters)) {
+    backend_factory_ = [backend_type, dictionary, parameters]() {
+        return createDetectorBackend(backend_type, dictionary, parameters);
+    };
+}
+
+SquareMarkerDetector::SquareMarkerDetector(const cv::aruco::Dictionary &dictionary,
+                                           const cv::aruco::DetectorParameters &parameters,
+                                           std::unique_ptr<DetectorBackend> backend)
+    : dictionary_(dictionary), backend_dictionary_(dictionary), parameters_(parameters),
+      configured_refinement_(parameters.cornerRefinementMethod) {
+    refine_lookup_corners_ = parameters_.cornerRefinementMethod == cv::aruco::CORNER_REFINE_SUBPIX;
+    region_searches_.emplace_back();
+    region_searches_.front().backend = std::move(backend);
+    region_searches_.front().parameters = parameters_;
+}
+
+void SquareMarkerDetector::setTracking(TrackingMode mode, int full_search_interval, double roi_padding) {
+    tracking_mode_ = mode;
+    full_search_interval_ = std::max(1, full_search_interval);
+    roi_padding_ = std::max(0.0, roi_padding);
+}
+
+void SquareMarkerDetector::setDecimation(int decimation, int min_marker_pixels) {
+    decimation_ = std::max(1, decimation);
+    min_marker_pixels_ = std::max(0, min_marker_pixels);
+    auto parameters = parameters_;
+    parameters.cornerRefinementMethod = configured_refinement_;
+    setParameters(parameters);
+    if (decimation_ > 1 && configured_refinement_ != cv::aruco::CORNER_REFINE_SUBPIX) {
+        logDecimatedRefinement();
+    }
+}
+
+void SquareMarkerDetector::logDecimatedRefinement() const {
+    if (configured_refinement_ == cv::aruco::CORNER_REFINE_NONE) {
+        SPDLOG_WARN("SquareMarkerDetector corner refinement None is overridden with decimation {0}, corners are "
+                    "refined with cornerSubPix on the original image", decimation_);
+    } else {
+        SPDLOG_WARN("SquareMarkerDetector corner refinement {0} only applies to the search with decimation {1}, "
+                    "corners are refined with cornerSubPix on the original image afterwards",
+                    configured_refinement_ == cv::aruco::CORNER_REFINE_CONTOUR ? "Contour" : "AprilTag", decimation_);
+    }
+}
+
+void SquareMarkerDetector::setTiling(int tile_size, int tile_overlap) {
+    if (tile_size > 0 && !backend_factory_) {
+        SPDLOG_WARN("SquareMarkerDetector tiling needs a backend type, custom backends search the whole frame");
+        tile_size = 0;
+    }
+    tile_size_ = std::max(0, tile_size);
+    tile_overlap_ = std::max(0, tile_overlap);
+    tile_image_size_ = cv::Size();
+    tiles_.clear();
+}
+
+std::size_t SquareMarkerDetector::tileCount() const {
+    return tiles_.size();
+}
+
+void SquareMarkerDetector::setParameters(const cv::aruco::DetectorParameters &parameters) {
+    auto previous_correction_rate = parameters_.errorCorrectionRate;
+    auto previous_refinement = parameters_.cornerRefinementMethod;
+    if (parameters.maxMarkerPerimeterRate != parameters_.maxMarkerPerimeterRate) {
+        // the tile overlap depends on the largest marker
+        tile_image_size_ = cv::Size();
+    }
+    auto refinement_changed = parameters.cornerRefinementMethod != configured_refinement_;
+    configured_refinement_ = parameters.cornerRefinementMethod;
+    parameters_ = parameters;
+    if (decimation_ > 1 && (configured_refinement_ == cv::aruco::CORNER_REFINE_SUBPIX
+        || configured_refinement_ == cv::aruco::CORNER_REFINE_NONE)) {
+        // corners are refined on the original image, subpixel refinement on the decimated image is wasted.
+        // contour and apriltag refinement need the contours of the search and stay with the search
+        parameters_.cornerRefinementMethod = cv::aruco::CORNER_REFINE_NONE;
+    }
+    if (decimation_ > 1 && refinement_changed && configured_refinement_ != cv::aruco::CORNER_REFINE_SUBPIX) {
+        logDecimatedRefinement();
+    }
+    refine_lookup_corners_ = parameters_.cornerRefinementMethod == cv::aruco::CORNER_REFINE_SUBPIX;
+    for (auto &search : region_searches_) {
+        search.parameters = parameters_;
+        search.backend->setParameters(parameters_);
+    }
+    // the index depends on the correction rate, AUTO on the refinement
+    if (decode_mode_ != DecodeMode::OPENCV && (parameters_.errorCorrectionRate != previous_correction_rate
+        || parameters_.cornerRefinementMethod != previous_refinement)) {
+        setDecodeMode(decode_mode_);
+    }
+}
+
+void SquareMarkerDetector::setAutoTuner(std::unique_ptr<DetectorAutoTuner> auto_tuner) {
+    auto_tuner_ = std::move(auto_tuner);
+}
+
+bool SquareMarkerDetector::setDecodeMode(DecodeMode mode) {
+    decode_mode_ = mode;
+    // the lookup only replicates the subpixel refinement of opencv
+    auto same_refinement = parameters_.cornerRefinementMethod == cv::aruco::CORNER_REFINE_NONE
+        || parameters_.cornerRefinementMethod == cv::aruco::CORNER_REFINE_SUBPIX;
+    use_lookup_ = mode == DecodeMode::LOOKUP
+        || (mode == DecodeMode::AUTO && dictionary_.bytesList.rows >= kAutoLookupMarkers && same_refinement);
+    if (use_lookup_ && !region_searches_.front().backend->supportsRejected()) {
+        // the backend decodes with its own dictionary and does not report the other candidates
+        if (mode == DecodeMode::LOOKUP) {
+            SPDLOG_WARN("SquareMarkerDetector lookup decoding needs the OpenCV detector backend");
+        }
+        use_lookup_ = false;
+    }
+    if (use_lookup_) {
+        use_lookup_ = dictionary_index_.build(dictionary_, parameters_.errorCorrectionRate);
+    }
+
+    if (use_lookup_) {
+        // every candidate of the opencv detector is identified by the index, keep its linear search minimal
+        backend_dictionary_ = cv::aruco::Dictionary(dictionary_.bytesList.rowRange(0, 1),
+                                                    dictionary_.markerSize,
+                                                    dictionary_.maxCorrectionBits);
+    } else {
+        backend_dictionary_ = dictionary_;
+    }
+    for (auto &search : region_searches_) {
+        search.backend->setDictionary(backend_dictionary_);
+    }
+    SPDLOG_INFO("SquareMarkerDetector {0} markers, decode by {1}",
+                dictionary_.bytesList.rows, use_lookup_ ? "lookup table" : "detector backend");
+    return use_lookup_;
+}
+
+void SquareMarkerDetector::detect(const cv::Mat &image,
+                                  MarkerCorners &markers,
+                                  MarkerIds &marker_ids,
+                                  const IsTrackedFunction &is_tracked,
+                                  MarkerCorners *rejected) {
+    // entries of markers and rejected are overwritten in place, their corner buffers are reused
+    marker_count_ = 0;
+    marker_ids.clear();
+    rejected_ = rejected;
+    rejected_count_ = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    bool full_search = tracking_mode_ == TrackingMode::FULL_FRAME
+        || tracked_ids_.empty()
+        || frames_since_full_search_ >= full_search_interval_;
+
+    if (!full_search) {
+        full_search = !detectTrackedRegions(image, markers, marker_ids);
+        if (full_search) {
+            SPDLOG_TRACE("SquareMarkerDetector lost tracked marker, fall back to full frame search");
+        }
+    }
+
+    if (full_search) {
+        detectFullFrame(image, markers, marker_ids);
+        frames_since_full_search_ = 0;
+    } else {
+        ++frames_since_full_search_;
+    }
+    markers.resize(marker_count_);
+    if (rejected_) {
+        rejected_->resize(rejected_count_);
+        rejected_ = nullptr;
+    }
+
+    if (decimation_ > 1) {
+        refineCorners(image, markers);
+    }
+
+    if (tracking_mode_ == TrackingMode::ROI) {
+        updateTrackedMarkers(markers, marker_ids, is_tracked);
+    }
+
+    if (auto_tuner_ && !auto_tuner_->isConverged()) {
+        auto detection_time = std::chrono::steady_clock::now() - start;
+        std::size_t subscribed_markers{0};
+        double max_perimeter{0};
+        for (std::size_t i = 0; i < marker_ids.size(); ++i) {
+            if (is_tracked(marker_ids[i])) {
+                ++subscribed_markers;
+                max_perimeter = std::max(max_perimeter, cv::arcLength(markers[i], true));
+            }
+        }
+        auto max_perimeter_rate = max_perimeter / std::max(image.cols, image.rows);
+        if (auto_tuner_->frameDone(detection_time, subscribed_markers, max_perimeter_rate)) {
+            setParameters(auto_tuner_->parameters());
+        }
+    }
+}
+
+void SquareMarkerDetector::detectFullFrame(const cv::Mat &image, MarkerCorners &markers, MarkerIds &marker_ids) {
+    // discards the results of a failed region search
+    marker_count_ = 0;
+    marker_ids.clear();
+    rejected_count_ = 0;
+    auto reference_size = std::max(image.cols, image.rows);
+    if (!updateTiles(image.size())) {
+        searchRegion(region_searches_.front(), image, reference_size);
+        collectRegion(region_searches_.front(), cv::Point2f(0, 0), false, markers, marker_ids);
+        return;
+    }
+
+    cv::parallel_for_(cv::Range(0, static_cast<int>(tiles_.size())), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; ++i) {
+            searchRegion(region_searches_[i], image(tiles_[i]), reference_size);
+        }
+    });
+    // collected in tile order, the lookup index and the output vectors are not thread safe
+    for (std::size_t i = 0; i < tiles_.size(); ++i) {
+        const cv::Point2f offset(static_cast<float>(tiles_[i].x), static_cast<float>(tiles_[i].y));
+        collectRegion(region_searches_[i], offset, true, markers, marker_ids);
+    }
+}
+
+bool SquareMarkerDetector::updateTiles(const cv::Size &image_size) {
+    if (tile_size_ <= 0 || (image_size.width <= tile_size_ && image_size.height <= tile_size_)) {
+        return false;
+    }
+    if (image_size == tile_image_size_) {
+        return !tiles_.empty();
+    }
+    tile_image_size_ = image_size;
+    tiles_.clear();
+
+    // a marker is only found if it fits completely into one tile, seams are only merged after decoding
+    auto max_marker_side = static_cast<int>(std::ceil(parameters_.maxMarkerPerimeterRate / 4
+                                                          * std::max(image_size.width, image_size.height)));
+    auto overlap = std::min(tile_overlap_ > 0 ? tile_overlap_ : max_marker_side, tile_size_ / 2);
+    if (overlap < max_marker_side) {
+        SPDLOG_WARN("SquareMarkerDetector tile overlap {0} covers markers up to {0} pixels, larger markers up to {1} "
+                    "pixels allowed by maxMarkerPerimeterRate can be missed on the seams of the {2} pixel tiles. "
+                    "Lower maxMarkerPerimeterRate or raise the tile size to find them",
+                    overlap, max_marker_side, tile_size_);
+    }
+    auto stride = tile_size_ - overlap;
+
+    std::vector<int> x_starts;
+    std::vector<int> y_starts;
+    tileStarts(image_size.width, tile_size_, stride, x_starts);
+    tileStarts(image_size.height, tile_size_, stride, y_starts);
+    tiles_.clear();
+    for (auto y : y_starts) {
+        for (auto x : x_starts) {
+            tiles_.emplace_back(x, y, std::min(tile_size_, image_size.width - x),
+                                std::min(tile_size_, image_size.height - y));
+        }
+    }
+
+    while (region_searches_.size() < tiles_.size()) {
+        RegionSearch search;
+        search.backend = backend_factory_();
+        search.backend->setParameters(parameters_);
+        search.backend->setDictionary(backend_dictionary_);
+        search.parameters = parameters_;
+        region_searches_.push_back(std::move(search));
+    }
+    SPDLOG_INFO("SquareMarkerDetector {0}x{1} image in {2} tiles of {3} pixels, overlap {4}",
+                image_size.width, image_size.height, tiles_.size(), tile_size_, overlap);
+    return true;
+}
+
+bool SquareMarkerDetector::detectTrackedRegions(const cv::Mat &image, MarkerCorners &markers, MarkerIds &marker_ids) {
+    const cv::Rect image_rect(0, 0, image.cols, image.rows);
+
+    regions_.clear();
+    for (const auto &corners : tracked_corners_) {
+        auto bounds = cv::boundingRect(corners);
+        auto padding = static_cast<int>(std::max(bounds.width, bounds.height) * roi_padding_) + 4;
+        cv::Rect region(bounds.x - padding, bounds.y - padding,
+                        bounds.width + 2 * padding, bounds.height + 2 * padding);
+        region &= image_rect;
+        if (!region.empty()) {
+            regions_.push_back(region);
+        }
+    }
+
+    // merge overlapping regions so no marker is detected twice
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (std::size_t i = 0; i < regions_.size() && !merged; ++i) {
+            for (std::size_t j = i + 1; j < regions_.size(); ++j) {
+                if ((regions_[i] & regions_[j]).area() > 0) {
+                    regions_[i] |= regions_[j];
+                    regions_.erase(regions_.begin() + j);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (const auto &region : regions_) {
+        const cv::Point2f offset(static_cast<float>(region.x), static_cast<float>(region.y));
+        auto region_image = image(region);
+        searchRegion(region_searches_.front(), region_image, std::max(region_image.cols, region_image.rows));
+        collectRegion(region_searches_.front(), offset, false, markers, marker_ids);
+    }
+
+    for (auto tracked_id : tracked_ids_) {
+        if (std::find(marker_ids.begin(), marker_ids.end(), tracked_id) == marker_ids.end()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SquareMarkerDetector::searchRegion(RegionSearch &search, const cv::Mat &region_image, int reference_size) {
+    // perimeter rates are relative to the larger image side, keep the marker sizes of the reference in pixels
+    auto region_size = std::max(region_image.cols, region_image.rows);
+    auto scale = static_cast<double>(reference_size) / region_size;
+    auto min_rate = min_marker_pixels_ > 0 ? 4.0 * min_marker_pixels_ / region_size
+                                           : parameters_.minMarkerPerimeterRate * scale;
+    auto max_rate = parameters_.maxMarkerPerimeterRate * scale;
+    if (min_rate != search.parameters.minMarkerPerimeterRate || max_rate != search.parameters.maxMarkerPerimeterRate) {
+        search.parameters.minMarkerPerimeterRate = min_rate;
+        search.parameters.maxMarkerPerimeterRate = max_rate;
+        search.backend->setParameters(search.parameters);
+    }
+
+    // the backend resizes the markers of the search, corner buffers of earlier regions are reused
+    search.detection_image = region_image;
+    if (decimation_ > 1) {
+        cv::resize(region_image, search.decimated_image, cv::Size(), 1.0 / decimation_, 1.0 / decimation_,
+                   cv::INTER_AREA);
+        search.detection_image = search.decimated_image;
+    }
+    // rejected candidates cost extra work in the backend, only request them if needed
+    search.backend->detect(search.detection_image, search.markers, search.marker_ids,
+                           use_lookup_ || rejected_ ? &search.rejected : nullptr);
+    if (!use_lookup_ && !rejected_) {
+        search.rejected.clear();
+    }
+}
+
+void SquareMarkerDetector::collectRegion(RegionSearch &search,
+                                         const cv::Point2f &offset,
+                                         bool merge_seams,
+                                         MarkerCorners &markers,
+                                         MarkerIds &marker_ids) {
+    if (use_lookup_) {
+        identifyCandidates(search);
+    }
+
+    for (std::size_t i = 0; i < search.marker_ids.size(); ++i) {
+        auto index = marker_count_;
+        appendCorners(search.markers[i], offset, markers, marker_count_);
+        if (merge_seams) {
+            // a marker in the overlap of two tiles is found by both with nearly the same corners
+            auto center = markerCenter(markers[index]);
+            auto max_distance = 0.25 * cv::norm(markers[index][0] - markers[index][1]);
+            bool duplicate = false;
+            for (std::size_t j = 0; j < marker_ids.size() && !duplicate; ++j) {
+                duplicate = marker_ids[j] == search.marker_ids[i]
+                    && cv::norm(markerCenter(markers[j]) - center) < max_distance;
+            }
+            if (duplicate) {
+                --marker_count_;
+                continue;
+            }
+        }
+        marker_ids.push_back(search.marker_ids[i]);
+    }
+    if (rejected_) {
+        for (const auto &candidate : search.rejected) {
+            // candidates identified by the lookup were moved to the markers
+            if (!candidate.empty()) {
+                appendCorners(candidate, offset, *rejected_, rejected_count_);
+            }
+        }
+    }
+}
+
+void SquareMarkerDetector::appendCorners(const std::vector<cv::Point2f> &region_corners,
+                                         const cv::Point2f &offset,
+                                         MarkerCorners &markers,
+                                         std::size_t &count) {
+    assignMarker(markers, count, region_corners);
+    auto scale = static_cast<float>(decimation_);
+    for (auto &corner : markers[count]) {
+        if (decimation_ > 1) {
+            // pixel centers of the decimated image cover scale x scale pixels of the original
+            corner = (corner + cv::Point2f(0.5f, 0.5f)) * scale - cv::Point2f(0.5f, 0.5f);
+        }
+        corner += offset;
+    }
+    ++count;
+}
+
+void SquareMarkerDetector::identifyCandidates(RegionSearch &search) {
+    const auto &image = search.detection_image;
+    // markers accepted by the single marker dictionary are candidates as well
+    search.rejected.insert(search.rejected.end(),
+                           std::make_move_iterator(search.markers.begin()),
+                           std::make_move_iterator(search.markers.end()));
+    search.markers.clear();
+    search.marker_ids.clear();
+
+    for (auto &candidate : search.rejected) {
+        int marker_id;
+        if (dictionary_index_.identify(image, candidate, marker_id, search.parameters)) {
+            search.markers.emplace_back(std::move(candidate));
+            search.marker_ids.push_back(marker_id);
+        }
+    }
+
+    // opencv only refines the markers it identified itself
+    if (refine_lookup_corners_ && !search.markers.empty()) {
+        refine_corners_.clear();
+        for (const auto &corners : search.markers) {
+            refine_corners_.insert(refine_corners_.end(), corners.begin(), corners.end());
+        }
+        auto window = parameters_.cornerRefinementWinSize;
+        cv::cornerSubPix(image,
+                         refine_corners_,
+                         cv::Size(window, window),
+                         cv::Size(-1, -1),
+                         cv::TermCriteria(cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS,
+                                          parameters_.cornerRefinementMaxIterations,
+                                          parameters_.cornerRefinementMinAccuracy));
+        auto refined = refine_corners_.begin();
+        for (auto &corners : search.markers) {
+            for (auto &corner : corners) {
+                corner = *refined++;
+            }
+        }
+    }
+}
+
+void SquareMarkerDetector::refineCorners(const cv::Mat &image, MarkerCorners &markers) {
+    if (markers.empty()) {
+        return;
+    }
+
+    refine_corners_.clear();
+    for (const auto &corners : markers) {
+        refine_corners_.insert(refine_corners_.end(), corners.begin(), corners.end());
+    }
+
+    // the window has to reach the true corner from a corner of the decimated image
+    auto window = std::max(parameters_.cornerRefinementWinSize, decimation_);
+    cv::cornerSubPix(image,
+                     refine_corners_,
+                     cv::Size(window, window),
+                     cv::Size(-1, -1),
+                     cv::TermCriteria(cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS,
+                                      parameters_.cornerRefinementMaxIterations,
+                                      parameters_.cornerRefinementMinAccuracy));
+
+    auto refined = refine_corners_.begin();
+    for (auto &corners : markers) {
+        for (auto &corner : corners) {
+            corner = *refined++;
+        }
+    }
+}
+
+void SquareMarkerDetector::updateTrackedMarkers(const MarkerCorners &markers,
+                                                const MarkerIds &marker_ids,
+                                                const IsTrackedFunction &is_tracked) {
+    std::size_t tracked_count{0};
+    tracked_ids_.clear();
+    for (std::size_t i = 0; i < marker_ids.size(); ++i) {
+        if (is_tracked(marker_ids[i])) {
+            assignMarker(tracked_corners_, tracked_count++, markers[i]);
+            tracked_ids_.push_back(marker_ids[i]);
+        }
+    }
+    tracked_corners_.resize(tracked_count);
+}
+
+}
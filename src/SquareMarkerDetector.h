@@ -0,0 +1,217 @@
+/** Copyright (C) 2022  Frieder Pankratz <frieder.pankratz@gmail.com> **/
+
+#ifndef TRAACTMULTI_SQUAREMARKERDETECTOR_H
+#define TRAACTMULTI_SQUAREMARKERDETECTOR_H
+
+#include <opencv2/aruco.hpp>
+#include "DictionaryIndex.h"
+#include "DetectorAutoTuner.h"
+#include "DetectorBackend.h"
+#include "MarkerFrame.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace traact::component::aruco {
+
+enum class TrackingMode {
+    FULL_FRAME = 0,
+    ROI
+};
+
+enum class DecodeMode {
+    /**
+     * Lookup for dictionaries with at least kAutoLookupMarkers markers, OpenCV otherwise or if the corners are
+     * refined by contour or AprilTag
+     */
+    AUTO = 0,
+    OPENCV,
+    LOOKUP
+};
+
+/**
+ * Detects square fiducial markers in a single channel image.
+ *
+ * In TrackingMode::ROI the corners of tracked markers from the previous frame are used to predict padded
+ * regions of interest and only these are searched. A full frame search is done every full_search_interval
+ * frames, when no marker is tracked or when a tracked marker was lost.
+ *
+ * With a decimation factor > 1 candidates are searched on a downscaled image and the corners are refined with
+ * cornerSubPix on the original image afterwards, with the subpixel settings of the parameters. Contour and AprilTag
+ * refinement are applied in the decimated search before that, a configured refinement other than subpix is
+ * logged as overridden.
+ *
+ * With DecodeMode::LOOKUP the candidates are identified by a DictionaryIndex instead of the linear search of
+ * OpenCV, the OpenCV detector only gets a single marker dictionary and reports all other candidates as rejected.
+ *
+ * The markers of a region are found by a DetectorBackend, backends without rejected candidates decode with their
+ * own dictionary and ignore the decode mode.
+ *
+ * With a tile size the full frame search is split into overlapping tiles, which are searched concurrently by
+ * cv::parallel_for_ with one backend per tile. A marker found in two tiles is only reported once. A marker is found
+ * if it is completely inside one tile, which holds for every marker with a side up to the overlap. The overlap is
+ * at most half a tile, so markers larger than that (e.g. with the default maxMarkerPerimeterRate of 4) can be
+ * missed on the seams, which is logged.
+ */
+class SquareMarkerDetector {
+ public:
+    using MarkerCorners = DetectorBackend::MarkerCorners;
+    using MarkerIds = DetectorBackend::MarkerIds;
+    using IsTrackedFunction = std::function<bool(int)>;
+
+    static constexpr int kAutoLookupMarkers = 250;
+
+    SquareMarkerDetector(const cv::aruco::Dictionary &dictionary,
+                         const cv::aruco::DetectorParameters &parameters,
+                         DetectorBackendType backend_type = DetectorBackendType::OPENCV);
+    /**
+     * Detector with a custom backend, e.g. recorded detections
+     */
+    SquareMarkerDetector(const cv::aruco::Dictionary &dictionary,
+                         const cv::aruco::DetectorParameters &parameters,
+                         std::unique_ptr<DetectorBackend> backend);
+
+    void setTracking(TrackingMode mode, int full_search_interval, double roi_padding);
+
+    /**
+     * @param decimation downscale factor for the candidate search, 1 searches on the original image
+     * @param min_marker_pixels minimal marker side length in pixels of the original image, 0 keeps the
+     * minMarkerPerimeterRate of the detector parameters
+     */
+    void setDecimation(int decimation, int min_marker_pixels);
+
+    /**
+     * @param tile_size side length in pixels of the tiles of a full frame search, 0 searches the frame at once
+     * @param tile_overlap overlap of neighbouring tiles in pixels, 0 uses the largest marker side allowed by
+     * maxMarkerPerimeterRate. Limited to half the tile size, this is the largest marker side found on the seams.
+     */
+    void setTiling(int tile_size, int tile_overlap);
+
+    /**
+     * tiles of the last full frame search, 0 if the frame was searched at once
+     */
+    std::size_t tileCount() const;
+
+    /**
+     * @return true if the lookup table is used
+     */
+    bool setDecodeMode(DecodeMode mode);
+
+    /**
+     * Replace the detector parameters, decimation and min_marker_pixels still override the corner refinement
+     * and the minimal perimeter rate
+     */
+    void setParameters(const cv::aruco::DetectorParameters &parameters);
+
+    /**
+     * Tune the parameters during detection until the tuner converged
+     */
+    void setAutoTuner(std::unique_ptr<DetectorAutoTuner> auto_tuner);
+
+    /**
+     * @param rejected if not nullptr, filled with the candidates without a valid id
+     */
+    void detect(const cv::Mat &image,
+                MarkerCorners &markers,
+                MarkerIds &marker_ids,
+                const IsTrackedFunction &is_tracked,
+                MarkerCorners *rejected = nullptr);
+
+ private:
+    /**
+     * Backend and buffers of one region search, each tile has its own so tiles can be searched concurrently
+     */
+    struct RegionSearch {
+        std::unique_ptr<DetectorBackend> backend;
+        cv::aruco::DetectorParameters parameters;
+        cv::Mat decimated_image;
+        cv::Mat detection_image;
+        MarkerCorners markers;
+        MarkerIds marker_ids;
+        MarkerCorners rejected;
+    };
+
+    void detectFullFrame(const cv::Mat &image, MarkerCorners &markers, MarkerIds &marker_ids);
+    bool detectTrackedRegions(const cv::Mat &image, MarkerCorners &markers, MarkerIds &marker_ids);
+    /**
+     * Run the backend on a region, thread safe for distinct searches
+     *
+     * @param reference_size larger side of the image the perimeter rates of the parameters refer to
+     */
+    void searchRegion(RegionSearch &search, const cv::Mat &region_image, int reference_size);
+    /**
+     * Decode lookup candidates and append the markers of a search in image coordinates
+     *
+     * @param merge_seams skip markers already found in another tile
+     */
+    void collectRegion(RegionSearch &search,
+                       const cv::Point2f &offset,
+                       bool merge_seams,
+                       MarkerCorners &markers,
+                       MarkerIds &marker_ids);
+    /**
+     * @return false if the image fits into a single tile
+     */
+    bool updateTiles(const cv::Size &image_size);
+    void appendCorners(const std::vector<cv::Point2f> &region_corners,
+                       const cv::Point2f &offset,
+                       MarkerCorners &markers,
+                       std::size_t &count);
+    void identifyCandidates(RegionSearch &search);
+    void refineCorners(const cv::Mat &image, MarkerCorners &markers);
+    void logDecimatedRefinement() const;
+    void updateTrackedMarkers(const MarkerCorners &markers, const MarkerIds &marker_ids, const IsTrackedFunction &is_tracked);
+
+    /**
+     * the first search is used for whole frames and tracked regions, the others only for tiles
+     */
+    std::vector<RegionSearch> region_searches_;
+    /**
+     * creates the backends of additional tiles, empty for a custom backend
+     */
+    std::function<std::unique_ptr<DetectorBackend>()> backend_factory_;
+    cv::aruco::Dictionary dictionary_;
+    /**
+     * dictionary given to the backends, a single marker dictionary for lookup decoding
+     */
+    cv::aruco::Dictionary backend_dictionary_;
+    cv::aruco::DetectorParameters parameters_;
+    bool refine_lookup_corners_{false};
+
+    TrackingMode tracking_mode_{TrackingMode::FULL_FRAME};
+    int full_search_interval_{30};
+    double roi_padding_{0.5};
+
+    int decimation_{1};
+    /**
+     * corner refinement of the parameters, parameters_ has none for the search on a decimated image
+     */
+    int configured_refinement_{cv::aruco::CORNER_REFINE_NONE};
+    int min_marker_pixels_{0};
+    std::vector<cv::Point2f> refine_corners_;
+
+    int tile_size_{0};
+    int tile_overlap_{0};
+    cv::Size tile_image_size_;
+    std::vector<cv::Rect> tiles_;
+
+    std::size_t marker_count_{0};
+    MarkerCorners *rejected_{nullptr};
+    std::size_t rejected_count_{0};
+
+    int frames_since_full_search_{0};
+    MarkerCorners tracked_corners_;
+    MarkerIds tracked_ids_;
+    std::vector<cv::Rect> regions_;
+
+    std::unique_ptr<DetectorAutoTuner> auto_tuner_;
+
+    DecodeMode decode_mode_{DecodeMode::OPENCV};
+    bool use_lookup_{false};
+    DictionaryIndex dictionary_index_;
+
+};
+
+}
+
+#endif //TRAACTMULTI_SQUAREMARKERDETECTOR_H